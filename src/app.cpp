@@ -39,6 +39,7 @@
 #include "menu_bar.hpp"
 #include "place_mode/place_mode.hpp"
 #include "pick_mode/pick_mode.hpp"
+#include "pick_mode/asset_index.hpp"
 #include "ent_mode/ent_mode.hpp"
 #include "map_man/map_man.hpp"
 
@@ -60,9 +61,10 @@ App::App()
     : _settings(),
     _mapMan        (std::make_unique<MapMan>()),
     _menuBar       (std::make_unique<MenuBar>(_settings, *_mapMan.get())),
+    _assetIndex    (std::make_unique<AssetIndex>(ASSET_INDEX_FILE_PATH)),
     _tilePlaceMode (std::make_unique<PlaceMode>(*_mapMan.get())),
-    _texPickMode   (std::make_unique<TexturePickMode>(_settings)),
-    _shapePickMode (std::make_unique<ShapePickMode>(_settings)),
+    _texPickMode   (std::make_unique<TexturePickMode>(_settings, *_assetIndex.get())),
+    _shapePickMode (std::make_unique<ShapePickMode>(_settings, *_assetIndex.get())),
     _entMode       (std::make_unique<EntMode>()),
     _editorMode    (_tilePlaceMode.get()),
     _lastSavedPath (),
@@ -292,6 +294,31 @@ void App::ShrinkMap()
     _tilePlaceMode->ResetCamera();
 }
 
+void App::ReplaceTiles(ReplaceTarget target, int16_t oldID, size_t i, size_t j, size_t k, size_t w, size_t h, size_t l)
+{
+    fs::path replacementPath = GetReplacementPath(target);
+    if (replacementPath.empty()) return;
+    int16_t newID = (target == ReplaceTarget::SHAPE) ? _mapMan->GetOrAddModelID(replacementPath) : _mapMan->GetOrAddTexID(replacementPath);
+    if (newID == ((target == ReplaceTarget::SHAPE) ? NO_MODEL : NO_TEX))
+    {
+        DisplayStatusMessage("ERROR: The map has too many shapes or textures to add the replacement.", 5.0f, 100);
+        return;
+    }
+    size_t count = _mapMan->ExecuteTileReplace(target, oldID, newID, i, j, k, w, h, l);
+    DisplayStatusMessage("Replaced " + std::to_string(count) + " tiles.", 5.0f, 100);
+}
+
+fs::path App::GetReplacementPath(ReplaceTarget target) const
+{
+    if (target == ReplaceTarget::SHAPE)
+    {
+        auto shape = _tilePlaceMode->GetCursorShape();
+        return shape ? shape->GetPath() : fs::path();
+    }
+    auto texture = _tilePlaceMode->GetCursorTextures()[(target == ReplaceTarget::SECONDARY_TEXTURE) ? 1 : 0];
+    return texture ? texture->GetPath() : fs::path();
+}
+
 void App::TryOpenMap(fs::path path)
 {
     _didSave = false;
@@ -370,7 +397,7 @@ void App::TrySaveMap(fs::path path)
     _didSave = true;
 }
 
-void App::TryExportMap(fs::path path, bool separateGeometry)
+void App::TryExportMap(fs::path path)
 {
     //Add correct extension if no extension is given.
     if (path.extension().empty())
@@ -382,7 +409,21 @@ void App::TryExportMap(fs::path path, bool separateGeometry)
 
     if (path.extension() == ".gltf" || path.extension() == ".glb") 
     {
-        if (_mapMan->ExportGLTFScene(path, separateGeometry))
+        MapMan::ExportOptions options;
+        options.separateGeometry = _settings.exportSeparateGeometry;
+        options.cullFaces = _settings.cullFaces;
+        options.chunkSize = _settings.exportChunks ? _settings.exportChunkSize : 0;
+        options.mergeFaces = _settings.exportMergeFaces;
+        options.optimizeMeshes = _settings.exportOptimizeMeshes;
+        options.quantize = _settings.exportQuantized;
+        options.atlasTextures = _settings.exportAtlas;
+        options.collision = _settings.exportCollision;
+        options.instanceTiles = _settings.exportInstancedTiles;
+        options.ambientOcclusion = _settings.exportAmbientOcclusion;
+        options.navGrid = _settings.exportNavGrid;
+        options.navHeightfield = _settings.exportNavHeightfield;
+
+        if (_mapMan->ExportGLTFScene(path, options))
         {
             DisplayStatusMessage(std::string("Exported map as ") + path.filename().string(), 5.0f, 100);
         }
@@ -435,10 +476,22 @@ App::Settings::Settings()
     undoMax = 30UL;
     mouseSensitivity = 0.5f;
     exportSeparateGeometry = false;
+    exportInstancedTiles = false;
+    exportChunks = false;
+    exportChunkSize = 16;
+    exportMergeFaces = false;
+    exportOptimizeMeshes = false;
+    exportQuantized = false;
+    exportAtlas = false;
+    exportCollision = false;
+    exportAmbientOcclusion = false;
+    exportNavGrid = false;
+    exportNavHeightfield = true;
     cullFaces = true;
     defaultTexturePath = "assets/textures/tiles/brickwall.png";
     defaultShapePath = "assets/models/shapes/cube.obj";
     assetHideRegex = ".+_(atlas|hidden)\\..+";
+    animateShapeIcons = true;
 }
 
 void App::to_json(nlohmann::json& json, const App::Settings& settings)
@@ -448,12 +501,24 @@ void App::to_json(nlohmann::json& json, const App::Settings& settings)
     json["undoMax"] = settings.undoMax;
     json["mouseSensitivity"] = settings.mouseSensitivity;
     json["exportSeparateGeometry"] = settings.exportSeparateGeometry;
+    json["exportInstancedTiles"] = settings.exportInstancedTiles;
+    json["exportChunks"] = settings.exportChunks;
+    json["exportChunkSize"] = settings.exportChunkSize;
+    json["exportMergeFaces"] = settings.exportMergeFaces;
+    json["exportOptimizeMeshes"] = settings.exportOptimizeMeshes;
+    json["exportQuantized"] = settings.exportQuantized;
+    json["exportAtlas"] = settings.exportAtlas;
+    json["exportCollision"] = settings.exportCollision;
+    json["exportAmbientOcclusion"] = settings.exportAmbientOcclusion;
+    json["exportNavGrid"] = settings.exportNavGrid;
+    json["exportNavHeightfield"] = settings.exportNavHeightfield;
     json["cullFaces"] = settings.cullFaces;
     json["exportFilePath"] = settings.exportFilePath;
     json["defaultTexturePath"] = settings.defaultTexturePath;
     json["defaultShapePath"] = settings.defaultShapePath;
     json["backgroundColor"] = settings.backgroundColor;
     json["assetHideRegex"] = settings.assetHideRegex;
+    json["animateShapeIcons"] = settings.animateShapeIcons;
 }
 
 void App::from_json(const nlohmann::json& json, App::Settings& settings)
@@ -465,10 +530,22 @@ void App::from_json(const nlohmann::json& json, App::Settings& settings)
     settings.undoMax                = json.value("undoMax", defaultSettings.undoMax);
     settings.mouseSensitivity       = json.value("mouseSensitivity", defaultSettings.mouseSensitivity);
     settings.exportSeparateGeometry = json.value("exportSeparateGeometry", defaultSettings.exportSeparateGeometry);
+    settings.exportInstancedTiles   = json.value("exportInstancedTiles", defaultSettings.exportInstancedTiles);
+    settings.exportChunks           = json.value("exportChunks", defaultSettings.exportChunks);
+    settings.exportChunkSize        = json.value("exportChunkSize", defaultSettings.exportChunkSize);
+    settings.exportMergeFaces       = json.value("exportMergeFaces", defaultSettings.exportMergeFaces);
+    settings.exportOptimizeMeshes   = json.value("exportOptimizeMeshes", defaultSettings.exportOptimizeMeshes);
+    settings.exportQuantized        = json.value("exportQuantized", defaultSettings.exportQuantized);
+    settings.exportAtlas            = json.value("exportAtlas", defaultSettings.exportAtlas);
+    settings.exportCollision        = json.value("exportCollision", defaultSettings.exportCollision);
+    settings.exportAmbientOcclusion = json.value("exportAmbientOcclusion", defaultSettings.exportAmbientOcclusion);
+    settings.exportNavGrid          = json.value("exportNavGrid", defaultSettings.exportNavGrid);
+    settings.exportNavHeightfield   = json.value("exportNavHeightfield", defaultSettings.exportNavHeightfield);
     settings.cullFaces              = json.value("cullFaces", defaultSettings.cullFaces);
     settings.exportFilePath         = json.value("exportFilePath", defaultSettings.exportFilePath);
     settings.defaultTexturePath     = json.value("defaultTexturePath", defaultSettings.defaultTexturePath);
     settings.defaultShapePath       = json.value("defaultShapePath", defaultSettings.defaultShapePath);
     settings.backgroundColor        = json.value("backgroundColor", defaultSettings.backgroundColor);
     settings.assetHideRegex         = json.value("assetHideRegex", defaultSettings.assetHideRegex);
+    settings.animateShapeIcons      = json.value("animateShapeIcons", defaultSettings.animateShapeIcons);
 }
\ No newline at end of file
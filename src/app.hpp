@@ -38,6 +38,7 @@ class ShapePickMode;
 class EntMode;
 class MenuBar;
 class MapMan;
+class AssetIndex;
 
 #define TEXT_FIELD_MAX 512
 
@@ -51,11 +52,23 @@ public:
         size_t undoMax;
         float mouseSensitivity;
         bool exportSeparateGeometry, cullFaces; // For GLTF export
+        bool exportInstancedTiles; // For GLTF export. Places shapes with EXT_mesh_gpu_instancing instead of baking them into one mesh.
+        bool exportChunks; // For GLTF export. Splits the map into nodes for each cube of `exportChunkSize` cels.
+        int exportChunkSize;
+        bool exportMergeFaces; // For GLTF export. Combines flat neighboring faces into bigger ones.
+        bool exportOptimizeMeshes; // For GLTF export. Welds vertices and reorders triangles for the vertex cache.
+        bool exportQuantized; // For GLTF export. Stores vertex attributes as 8 and 16 bit integers.
+        bool exportAtlas; // For GLTF export. Packs the tile textures into atlases so that there are fewer materials.
+        bool exportCollision; // For GLTF export. Adds a simplified collision node.
+        bool exportAmbientOcclusion; // For GLTF export. Bakes ambient occlusion into the vertex colors.
+        bool exportNavGrid; // For GLTF export. Saves a binary occupancy grid for pathfinding next to the file.
+        bool exportNavHeightfield; // For GLTF export. Adds a heightfield to the navigation grid.
         std::string exportFilePath; // For GLTF export
         std::string defaultTexturePath;
         std::string defaultShapePath;
         std::tuple<uint8_t, uint8_t, uint8_t> backgroundColor;
         std::string assetHideRegex;
+        bool animateShapeIcons; // If false, shape picker icons are rendered once and don't spin
 
         Settings();
     };
@@ -110,9 +123,13 @@ public:
     void NewMap(int width, int height, int length);
     void ExpandMap(Direction axis, int amount);
     void ShrinkMap();
+    // Replaces `oldID` in the tiles inside of the rectangular prism with a corner at (i, j, k) and size (w, h, l) with the tile cursor's shape or texture.
+    void ReplaceTiles(ReplaceTarget target, int16_t oldID, size_t i, size_t j, size_t k, size_t w, size_t h, size_t l);
+    // Returns the path of the tile cursor's shape or texture that ReplaceTiles puts in, or an empty path if there is none yet.
+    fs::path GetReplacementPath(ReplaceTarget target) const;
     void TryOpenMap(fs::path path);
     void TrySaveMap(fs::path path);
-    void TryExportMap(fs::path path, bool separateGeometry);
+    void TryExportMap(fs::path path);
 
     // Serializes settings into JSON file and exports.
     void SaveSettings();
@@ -125,6 +142,7 @@ private:
     
     std::unique_ptr<MapMan> _mapMan;
     std::unique_ptr<MenuBar> _menuBar;
+    std::unique_ptr<AssetIndex> _assetIndex; // Shared by the texture and shape pickers
 
     std::unique_ptr<PlaceMode> _tilePlaceMode;
     std::unique_ptr<TexturePickMode> _texPickMode;
@@ -63,6 +63,20 @@ protected:
     Direction _direction;
 };
 
+class ReplaceTilesDialog : public Dialog
+{
+public:
+    ReplaceTilesDialog();
+    virtual bool Draw() override;
+protected:
+    std::vector<TexID> _usedTexIDs;
+    std::vector<ModelID> _usedModelIDs;
+    ReplaceTarget _target;
+    int _oldIndex; // Index into the used texture or model IDs
+    bool _limitRegion;
+    int _regionMin[3], _regionMax[3];
+};
+
 class FileDialog : public Dialog
 {
 public:
@@ -67,12 +67,33 @@ bool ExportDialog::Draw()
         }
         _settings.exportFilePath = _filePathBuffer;
 
+        ImGui::Checkbox("Export tiles as GPU instances", &_settings.exportInstancedTiles);
+        // Instanced tiles share their shapes' meshes, so none of the options that change the baked tile geometry apply to them.
+        ImGui::BeginDisabled(_settings.exportInstancedTiles);
         ImGui::Checkbox("Seperate nodes for each texture", &_settings.exportSeparateGeometry);
         ImGui::Checkbox("Cull redundant faces between tiles", &_settings.cullFaces);
+        ImGui::Checkbox("Merge coplanar faces", &_settings.exportMergeFaces);
+        ImGui::Checkbox("Weld vertices and optimize triangle order", &_settings.exportOptimizeMeshes);
+        ImGui::Checkbox("Quantize vertex data (KHR_mesh_quantization)", &_settings.exportQuantized);
+        ImGui::Checkbox("Bake textures into atlases (no face merging)", &_settings.exportAtlas);
+        ImGui::Checkbox("Bake ambient occlusion into vertex colors (no face merging)", &_settings.exportAmbientOcclusion);
+        ImGui::Checkbox("Split into chunks", &_settings.exportChunks);
+        if (_settings.exportChunks)
+        {
+            ImGui::InputInt("Chunk size (grid cels)", &_settings.exportChunkSize, 1, 8);
+            if (_settings.exportChunkSize < 1) _settings.exportChunkSize = 1;
+        }
+        ImGui::EndDisabled();
+        ImGui::Checkbox("Generate simplified collision", &_settings.exportCollision);
+        ImGui::Checkbox("Save navigation grid (.nav)", &_settings.exportNavGrid);
+        if (_settings.exportNavGrid)
+        {
+            ImGui::Checkbox("Include heightfield", &_settings.exportNavHeightfield);
+        }
 
         if (ImGui::Button("Export##exportgltf"))
         {
-            App::Get()->TryExportMap(fs::path(_settings.exportFilePath), _settings.exportSeparateGeometry);
+            App::Get()->TryExportMap(fs::path(_settings.exportFilePath));
             App::Get()->SaveSettings();
             ImGui::EndPopup();
             return false;
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2022-present Alexander Lunsford
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#include "dialogs.hpp"
+
+#include "imgui/imgui.h"
+
+#include "../app.hpp"
+#include "../map_man/map_man.hpp"
+
+ReplaceTilesDialog::ReplaceTilesDialog()
+    : _target(ReplaceTarget::TEXTURES),
+      _oldIndex(0),
+      _limitRegion(false)
+{
+    const TileGrid &map = App::Get()->GetMapMan().Tiles();
+    std::tie(_usedTexIDs, _usedModelIDs) = map.GetUsedIDs();
+    _regionMin[0] = _regionMin[1] = _regionMin[2] = 0;
+    _regionMax[0] = map.GetWidth() - 1;
+    _regionMax[1] = map.GetHeight() - 1;
+    _regionMax[2] = map.GetLength() - 1;
+}
+
+bool ReplaceTilesDialog::Draw()
+{
+    bool open = true;
+    ImGui::OpenPopup("REPLACE TILES");
+    ImVec2 center = ImGui::GetMainViewport()->GetCenter();
+    ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
+    if (ImGui::BeginPopupModal("REPLACE TILES", &open, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        const MapMan &mapMan = App::Get()->GetMapMan();
+
+        if (ImGui::Combo("Replace", (int*)(&_target), "Shape\0Textures\0Primary texture\0Secondary texture\0"))
+        {
+            _oldIndex = 0;
+        }
+
+        // Only the shapes and textures that are in the map can be found.
+        bool shapes = (_target == ReplaceTarget::SHAPE);
+        size_t usedCount = shapes ? _usedModelIDs.size() : _usedTexIDs.size();
+        auto usedName = [&](size_t index)->std::string
+        {
+            return shapes ? mapMan.PathFromModelID(_usedModelIDs[index]).generic_string() : mapMan.PathFromTexID(_usedTexIDs[index]).generic_string();
+        };
+        if (ImGui::BeginCombo("Find", (usedCount > 0) ? usedName(_oldIndex).c_str() : "(none in map)"))
+        {
+            for (size_t u = 0; u < usedCount; ++u)
+            {
+                if (ImGui::Selectable(usedName(u).c_str(), (int)u == _oldIndex)) _oldIndex = (int)u;
+            }
+            ImGui::EndCombo();
+        }
+
+        // The replacement is whatever the cursor has, so it can be chosen with the pickers.
+        fs::path replacementPath = App::Get()->GetReplacementPath(_target);
+        ImGui::Text("With (from cursor): %s", replacementPath.empty() ? "(none)" : replacementPath.generic_string().c_str());
+
+        ImGui::Checkbox("Only inside of region", &_limitRegion);
+        if (_limitRegion)
+        {
+            ImGui::InputInt3("From X, Y, Z", _regionMin);
+            ImGui::InputInt3("To X, Y, Z", _regionMax);
+        }
+
+        if (ImGui::Button("REPLACE") && usedCount > 0 && !replacementPath.empty())
+        {
+            size_t i = 0, j = 0, k = 0;
+            size_t w = mapMan.Tiles().GetWidth(), h = mapMan.Tiles().GetHeight(), l = mapMan.Tiles().GetLength();
+            if (_limitRegion)
+            {
+                i = Max(Min(_regionMin[0], _regionMax[0]), 0);
+                j = Max(Min(_regionMin[1], _regionMax[1]), 0);
+                k = Max(Min(_regionMin[2], _regionMax[2]), 0);
+                w = Max(Max(_regionMin[0], _regionMax[0]) + 1 - (int)i, 0);
+                h = Max(Max(_regionMin[1], _regionMax[1]) + 1 - (int)j, 0);
+                l = Max(Max(_regionMin[2], _regionMax[2]) + 1 - (int)k, 0);
+            }
+            int16_t oldID = shapes ? _usedModelIDs[_oldIndex] : _usedTexIDs[_oldIndex];
+            App::Get()->ReplaceTiles(_target, oldID, i, j, k, w, h, l);
+            ImGui::EndPopup();
+            return false;
+        }
+
+        ImGui::EndPopup();
+        return true;
+    }
+    return open;
+}
@@ -52,6 +52,8 @@ bool SettingsDialog::Draw()
         
         ImGui::SliderFloat("Mouse sensitivity", &_settingsCopy.mouseSensitivity, 0.05f, 10.0f, "%.1f", ImGuiSliderFlags_NoRoundToFormat);
 
+        ImGui::Checkbox("Spin shape picker icons", &_settingsCopy.animateShapeIcons);
+
         float bgColorf[3] = { 
             (float)std::get<0>(_settingsCopy.backgroundColor) / 255.0f, 
             (float)std::get<1>(_settingsCopy.backgroundColor) / 255.0f, 
@@ -45,7 +45,13 @@ bool ShortcutsDialog::Draw()
         "H (when layers are isolated)", "Unhide hidden layers.",
         "Hold H while using scrollwheel", "Select multiple layers to isolate.",
         "LEFT SHIFT+B", "Capture tiles under cursor as a brush.",
+        "LEFT CTRL+F", "Fill the connected tiles matching the one under the cursor (only on visible layers).",
+        "LEFT CTRL+LEFT ALT+F", "Fill, connecting tiles diagonally as well.",
+        "LEFT SHIFT+[ or ]", "Rotate the selected tiles counterclockwise or clockwise.",
+        "LEFT SHIFT+M/N/U", "Mirror the selected tiles along the X, Z, or Y axis.",
+        "LEFT SHIFT+Arrow keys/PAGE UP/PAGE DOWN", "Move the selected tiles.",
         "ESCAPE/BACKSPACE", "Return cursor to tile mode.",
+        "P", "Switch between placing the cursor on the grid, in front of tiles under the mouse, or on them.",
         "LEFT CTRL+TAB", "Switch between entity editor and map editor.",
         "LEFT CTRL+E", "Put cursor into entity mode.",
         "T/G (Entity mode)", "Copy entity from under cursor.",
@@ -60,9 +60,8 @@ Ent::Ent(float radius)
     texture = nullptr;
 }
 
-void Ent::Draw(const bool drawAxes, const Vector3 position)
+void Ent::Draw(const bool drawAxes, const Vector3 position) const
 {
-    lastRenderedPosition = position;
     // All sprites share the same material, and the texture is changed for each one
     static Material spriteMaterial = LoadMaterialDefault();
 
@@ -180,7 +179,7 @@ EntGrid::EntGrid()
 EntGrid::EntGrid(size_t width, size_t height, size_t length)
     : Grid<Ent>(width, height, length, ENT_SPACING_DEFAULT, Ent())
 {
-    _labelsToDraw.reserve(_grid.size());
+    _labelsToDraw.reserve(_celCount);
 }
 
 void EntGrid::Draw(Camera &camera, int fromY, int toY)
@@ -189,20 +188,25 @@ void EntGrid::Draw(Camera &camera, int fromY, int toY)
 
     for (size_t i = fromY * _width * _length; i < (toY + 1) * _width * _length; ++i)
     {
-        if (!_grid[i].active) continue;
+        if (!_GetCelAt(i).active) continue;
+
+        // Only write to the cel when the position is out of date, since that copies its chunk if it's shared with the undo history.
+        Vector3 position = GridToWorldPos(UnflattenIndex(i), true);
+        if (!Vector3Equals(_GetCelAt(i).lastRenderedPosition, position)) _GetMutableCelAt(i).lastRenderedPosition = position;
+        const Ent& ent = _GetCelAt(i);
 
         // Do frustum culling check
-        Vector3 ndc = GetWorldToNDC(_grid[i].lastRenderedPosition, camera);
+        Vector3 ndc = GetWorldToNDC(position, camera);
         if (ndc.z < 1.0f && ndc.x > -1.0f && ndc.x < 1.0f && ndc.y > -1.0f && ndc.y < 1.0f)
         {
             bool drawExtras = (ndc.z < DISPLAY_NAME_THRESHOLD);
 
-            if (drawExtras && _grid[i].properties.find("name") != _grid[i].properties.end()) 
+            if (drawExtras && ent.properties.find("name") != ent.properties.end()) 
             {
-                _labelsToDraw.push_back(std::make_pair(ndc, _grid[i].properties["name"]));
+                _labelsToDraw.push_back(std::make_pair(ndc, ent.properties.at("name")));
             }
             
-            _grid[i].Draw(drawExtras && !App::Get()->IsPreviewing(), GridToWorldPos(UnflattenIndex(i), true));
+            ent.Draw(drawExtras && !App::Get()->IsPreviewing(), position);
         }
     }
 }
@@ -61,7 +61,10 @@ struct Ent
     Ent();
     Ent(float radius);
 
-    void Draw(const bool drawAxes, const Vector3 position);
+    // Entities that are not active are empty spaces in the EntGrid.
+    inline explicit operator bool() const { return active; }
+
+    void Draw(const bool drawAxes, const Vector3 position) const;
 };
 
 void to_json(nlohmann::json& j, const Ent &ent);
@@ -102,7 +105,7 @@ public:
 
     inline void CopyEnts(int i, int j, int k, const EntGrid &src)
     {
-        return CopyCels(i, j, k, src);
+        CopyCels(i, j, k, src);
     }
 
     //Returns a smaller grid with a copy of the ent data in the rectangle defined by coordinates (i, j, k) and size (w, h, l).
@@ -122,8 +125,9 @@ public:
     inline std::vector<Ent> GetEntList() const
     {
         std::vector<Ent> out;
-        for (const Ent &ent : _grid)
+        for (size_t i = 0; i < _celCount; ++i)
         {
+            const Ent &ent = _GetCelAt(i);
             if (ent.active) out.push_back(ent);
         }
         return out;
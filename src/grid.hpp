@@ -22,13 +22,103 @@
 #define GRID_H
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <vector>
+#include <array>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
 #include <assert.h>
 
 #include "math_stuff.hpp"
 
-// Represents a 3 dimensional array of tiles and provides functions for converting coordinates.
+// Each chunk of a grid holds 2^GRID_CHUNK_BITS cels.
+#define GRID_CHUNK_BITS 12
+
+// Cels are stored in rows along the X axis, one layer after another, which is the same order as Grid::FlatIndex.
+struct LinearLayout
+{
+    static constexpr bool FLAT_ORDER = true;
+
+    static inline size_t StorageSize(size_t width, size_t height, size_t length)
+    {
+        return width * height * length;
+    }
+
+    static inline size_t StorageIndex(size_t i, size_t j, size_t k, size_t width, size_t height, size_t length)
+    {
+        return i + (k * width) + (j * width * length);
+    }
+};
+
+// Cels are stored in cubic bricks that each fill one chunk, with the cels of each brick in Morton (Z-curve) order.
+// The neighbors of a cel along all three axes are usually in the same brick, instead of a whole layer away.
+struct MortonLayout
+{
+    static constexpr bool FLAT_ORDER = false;
+    static constexpr size_t BRICK_BITS = GRID_CHUNK_BITS / 3;
+    static constexpr size_t BRICK_SIZE = size_t(1) << BRICK_BITS;
+    static_assert(BRICK_BITS * 3 == GRID_CHUNK_BITS, "Morton bricks must fill a chunk exactly");
+
+    static inline size_t StorageSize(size_t width, size_t height, size_t length)
+    {
+        return _Bricks(width) * _Bricks(height) * _Bricks(length) << GRID_CHUNK_BITS;
+    }
+
+    static inline size_t StorageIndex(size_t i, size_t j, size_t k, size_t width, size_t height, size_t length)
+    {
+        size_t brick = (i >> BRICK_BITS) + ((k >> BRICK_BITS) * _Bricks(width)) + ((j >> BRICK_BITS) * _Bricks(width) * _Bricks(length));
+        const size_t mask = BRICK_SIZE - 1;
+        return (brick << GRID_CHUNK_BITS) | _Spread(i & mask) | (_Spread(j & mask) << 1) | (_Spread(k & mask) << 2);
+    }
+
+private:
+    static inline size_t _Bricks(size_t cels) { return (cels + BRICK_SIZE - 1) >> BRICK_BITS; }
+
+    // Spaces out the bits of a coordinate inside of a brick so that there are two zero bits between each one.
+    static inline size_t _Spread(size_t v)
+    {
+        static constexpr uint16_t SPREAD_BITS[16] = { 0, 1, 8, 9, 64, 65, 72, 73, 512, 513, 520, 521, 576, 577, 584, 585 };
+        static_assert(BRICK_BITS == 4, "The lookup table only covers 4 bit coordinates");
+        return SPREAD_BITS[v];
+    }
+};
+
+// A chunk that keeps its cels in an array of their stored values.
+template<class Stored>
+struct ArrayChunk
+{
+    std::array<Stored, size_t(1) << GRID_CHUNK_BITS> cels;
+
+    inline explicit ArrayChunk(const Stored &fill) { cels.fill(fill); }
+    inline const Stored& Get(size_t index) const { return cels[index]; }
+    inline void Set(size_t index, const Stored &stored) { cels[index] = stored; }
+};
+
+// Cels are stored as they are.
 template<class Cel>
+struct PlainCelStorage
+{
+    using Stored = Cel;
+    using Chunk = ArrayChunk<Cel>;
+    static constexpr bool HAS_PALETTE = false;
+
+    static inline const Cel& Unpack(const Cel &cel) { return cel; }
+    static inline const Cel& Pack(const Cel &cel) { return cel; }
+    static inline bool IsOccupied(const Cel &cel) { return static_cast<bool>(cel); }
+    static inline bool CanPack(const Cel &cel) { return true; }
+    static inline bool CanPack(const std::vector<Cel> &cels) { return true; }
+};
+
+// Represents a 3 dimensional array of tiles and provides functions for converting coordinates.
+// Cels that convert to true are occupied. The grid keeps count of them in each layer, row, and slice as it is changed,
+// so the occupied parts of the grid can be found without looking at every cel.
+// The cels are stored in chunks that are shared between copies of the grid until one of them changes a cel in the chunk,
+// so copying a grid only copies a list of chunks.
+// `Layout` decides the order of the cels in storage. It does not change the coordinates or flat indices that are used to access them.
+// `Storage` decides how each cel is encoded in storage, and the type of chunk that holds them. Each grid has its own instance,
+// so storage can keep state that the encoding depends on. Cels are always read and written as `Cel` values.
+template<class Cel, class Layout = LinearLayout, class Storage = PlainCelStorage<Cel>>
 class Grid
 {
 public:
@@ -36,9 +126,18 @@ public:
     inline Grid(size_t width, size_t height, size_t length, float spacing, const Cel &fill)
     {
         _width = width; _height = height; _length = length; _spacing = spacing;
-        _grid.resize(width * height * length);
+        _celCount = width * height * length;
 
-        for (size_t i = 0; i < _grid.size(); ++i) { _grid[i] = fill; }
+        // Every chunk starts out as the same filled chunk.
+        auto filledChunk = std::make_shared<Chunk>(_storage.Pack(fill));
+        _chunks.assign((Layout::StorageSize(width, height, length) + CHUNK_SIZE - 1) / CHUNK_SIZE, filledChunk);
+
+        bool occupied = static_cast<bool>(fill);
+        _occupiedCount = occupied ? _celCount : 0;
+        _layerCounts.assign(_height, occupied ? _width * _length : 0);
+        _rowCounts.assign(_height * _length, occupied ? _width : 0);
+        _xCounts.assign(_width, occupied ? _height * _length : 0);
+        _zCounts.assign(_length, occupied ? _width * _height : 0);
     }
 
     // Constructs a grid full of default-constructed cels.
@@ -94,7 +193,7 @@ public:
 
     inline Vector3 UnflattenIndex(size_t idx) const 
     {
-        assert(idx < _grid.size());
+        assert(idx < _celCount);
         return Vector3{
             (float)(idx % _width),
             (float)(idx / (_width * _length)),
@@ -122,20 +221,42 @@ public:
         return Vector3 { (float)_width * _spacing / 2.0f, (float)_height * _spacing / 2.0f, (float)_length * _spacing / 2.0f };
     }
 
+    inline size_t GetOccupiedCount() const { return _occupiedCount; }
+    // Returns the number of occupied cels in the layer at the y coordinate.
+    inline size_t GetLayerOccupiedCount(int j) const { return _layerCounts[j]; }
+    // Returns the number of occupied cels in the row along the X axis at the y and z coordinates.
+    inline size_t GetRowOccupiedCount(int j, int k) const { return _rowCounts[j * _length + k]; }
+
+    // Finds the smallest box containing all of the occupied cels, with corners at min and max (inclusive). Returns false if there are none.
+    // This only looks at the counts for each slice of the grid along each axis.
+    inline bool GetOccupiedBounds(size_t &minX, size_t &minY, size_t &minZ, size_t &maxX, size_t &maxY, size_t &maxZ) const
+    {
+        if (_occupiedCount == 0) return false;
+        for (minX = 0; _xCounts[minX] == 0; ++minX);
+        for (maxX = _width - 1; _xCounts[maxX] == 0; --maxX);
+        for (minY = 0; _layerCounts[minY] == 0; ++minY);
+        for (maxY = _height - 1; _layerCounts[maxY] == 0; --maxY);
+        for (minZ = 0; _zCounts[minZ] == 0; ++minZ);
+        for (maxZ = _length - 1; _zCounts[maxZ] == 0; --maxZ);
+        return true;
+    }
+
 protected:
-    inline void SetCel(int i, int j, int k, const Cel& cel) 
+    // Returns false if the cel couldn't be stored (see _MakeRoomFor).
+    inline bool SetCel(int i, int j, int k, const Cel& cel) 
     {
         if (i >= 0 && j >= 0 && k >= 0 && (size_t)i < _width && (size_t)j < _height && (size_t)k < _length) 
         {
-            _grid[FlatIndex(i, j, k)] = cel;
+            return _ReplaceCel(i, j, k, cel);
         }
+        return true;
     }
 
     inline Cel GetCel(int i, int j, int k) const 
     {
         if (i >= 0 && j >= 0 && k >= 0 && (size_t)i < _width && (size_t)j < _height && (size_t)k < _length) 
         {
-            return _grid[FlatIndex(i, j, k)];
+            return _GetCelAt(i, j, k);
         } 
         else 
         {
@@ -143,9 +264,11 @@ protected:
         }
     }
 
-    inline void CopyCels(int i, int j, int k, const Grid<Cel> &src)
+    // Returns false without changing anything if the cels from `src` couldn't all be stored.
+    inline bool CopyCels(int i, int j, int k, const Grid &src)
     {
-        if (!(i >= 0 && j >= 0 && k >= 0 && (size_t)i < _width && (size_t)j < _height && (size_t)k < _length)) return;
+        if (!(i >= 0 && j >= 0 && k >= 0 && (size_t)i < _width && (size_t)j < _height && (size_t)k < _length)) return true;
+        if (!_MakeRoomFor(src)) return false;
         int xEnd = Min(i + src._width, _width); 
         int yEnd = Min(j + src._height, _height);
         int zEnd = Min(k + src._length, _length);
@@ -153,36 +276,272 @@ protected:
         {
             for (int y = j; y < yEnd; ++y)
             {
-                size_t ourBase = FlatIndex(0, y, z);
-                size_t theirBase = src.FlatIndex(0, y - j, z - k);
-                for (int x = i; x < xEnd; ++x)
-                {
-                    const Cel &cel = src._grid[theirBase + (x - i)];
-                    _grid[ourBase + x] = cel;
-                }
+                _CopyRow(i, y, z, src, 0, y - j, z - k, xEnd - i);
             }
         }
+        return true;
     }
 
-    inline void SubsectionCopy(int i, int j, int k, int w, int h, int l, Grid<Cel> &out) const
+    inline void SubsectionCopy(int i, int j, int k, int w, int h, int l, Grid &out) const
     {
         for (int z = k; z < k + l; ++z) 
         {
             for (int y = j; y < j + h; ++y)
             {
-                size_t ourBase = FlatIndex(0, y, z);
-                size_t theirBase = out.FlatIndex(0, y - j, z - k);
-                for (int x = i; x < i + w; ++x)
+                out._CopyRow(0, y - j, z - k, *this, i, y, z, w);
+            }
+        }
+    }
+
+    // Makes sure that the storage can hold all of the cels. Storage with a palette that is full first drops the entries that no cel uses anymore.
+    // Returns false if there still isn't room.
+    inline bool _MakeRoomFor(const std::vector<Cel>& cels)
+    {
+        if (_storage.CanPack(cels)) return true;
+        if constexpr (Storage::HAS_PALETTE)
+        {
+            _CompactPalette();
+            return _storage.CanPack(cels);
+        }
+        return false;
+    }
+
+    // Makes room for all of the cels in the other grid.
+    inline bool _MakeRoomFor(const Grid& src)
+    {
+        if constexpr (Storage::HAS_PALETTE) return _MakeRoomFor(src._storage.GetPalette());
+        return true;
+    }
+
+    // Rebuilds the palette from the cels that are in the grid, and changes the cels to the new indices.
+    inline void _CompactPalette()
+    {
+        std::vector<bool> used(_storage.GetPalette().size(), false);
+        for (const std::shared_ptr<Chunk>& chunk : _chunks)
+        {
+            for (size_t c = 0; c < CHUNK_SIZE; ++c) used[chunk->Get(c)] = true;
+        }
+        const std::vector<Stored> newIndices = _storage.Compact(used);
+        for (size_t n = 0; n < _chunks.size(); ++n)
+        {
+            // Chunks whose cels keep the same indices are left alone, so they stay shared.
+            bool changed = false;
+            for (size_t c = 0; c < CHUNK_SIZE && !changed; ++c) changed = (newIndices[_chunks[n]->Get(c)] != _chunks[n]->Get(c));
+            if (!changed) continue;
+            Chunk& chunk = _GetMutableChunk(n << GRID_CHUNK_BITS);
+            for (size_t c = 0; c < CHUNK_SIZE; ++c) chunk.Set(c, newIndices[chunk.Get(c)]);
+        }
+    }
+
+    // Sets the cel at (i, j, k), updating the occupancy counts if it changes between empty and occupied.
+    // Returns false without changing the cel if it can't be stored.
+    inline bool _ReplaceCel(int i, int j, int k, const Cel& cel)
+    {
+        if (!_storage.CanPack(cel) && !_MakeRoomFor(std::vector<Cel>{ cel })) return false;
+        size_t storageIndex = _StorageIndex(i, j, k);
+        Chunk& chunk = _GetMutableChunk(storageIndex);
+        bool wasOccupied = _storage.IsOccupied(chunk.Get(storageIndex & (CHUNK_SIZE - 1)));
+        bool isOccupied = static_cast<bool>(cel);
+        chunk.Set(storageIndex & (CHUNK_SIZE - 1), _storage.Pack(cel));
+        if (wasOccupied != isOccupied) _CountCel(i, j, k, isOccupied ? 1 : -1);
+        return true;
+    }
+
+    inline bool _ReplaceCel(size_t flatIndex, const Cel& cel)
+    {
+        Vector3 gridPos = UnflattenIndex(flatIndex);
+        return _ReplaceCel((int)gridPos.x, (int)gridPos.y, (int)gridPos.z, cel);
+    }
+
+    // Sets `count` cels in a row starting at the flat index. The run may continue onto the following rows.
+    // Returns false without changing any cels if the cel can't be stored.
+    inline bool _FillCels(size_t flatIndex, size_t count, const Cel& cel)
+    {
+        assert(flatIndex + count <= _celCount);
+        if (!_storage.CanPack(cel) && !_MakeRoomFor(std::vector<Cel>{ cel })) return false;
+        const bool isOccupied = static_cast<bool>(cel);
+        const Stored stored = _storage.Pack(cel);
+        const size_t end = flatIndex + count;
+        size_t c = flatIndex;
+        while (c < end)
+        {
+            // Fill the part of the run that is in both the same row and the same chunk at once.
+            size_t row = c / _width;
+            size_t segmentEnd = std::min({ end, (row + 1) * _width, ((c >> GRID_CHUNK_BITS) + 1) << GRID_CHUNK_BITS });
+            size_t i = c - row * _width, j = row / _length, k = row % _length;
+
+            // Only rows in the linear layout are stored contiguously.
+            if constexpr (!Layout::FLAT_ORDER)
+            {
+                for (size_t x = i; x < i + (segmentEnd - c); ++x) _ReplaceCel(x, j, k, cel);
+                c = segmentEnd;
+                continue;
+            }
+
+            Chunk& chunk = _GetMutableChunk(c);
+            const size_t offset = c & (CHUNK_SIZE - 1);
+            int delta = 0;
+            for (size_t n = 0; n < segmentEnd - c; ++n)
+            {
+                if (_storage.IsOccupied(chunk.Get(offset + n)) != isOccupied)
                 {
-                    out._grid[theirBase + (x - i)] = _grid[ourBase + x];
+                    _xCounts[i + n] += isOccupied ? 1 : -1;
+                    delta += isOccupied ? 1 : -1;
                 }
+                chunk.Set(offset + n, stored);
+            }
+            if (delta != 0)
+            {
+                _occupiedCount += delta;
+                _layerCounts[j] += delta;
+                _rowCounts[row] += delta;
+                _zCounts[k] += delta;
             }
+            c = segmentEnd;
         }
+        return true;
+    }
+
+    // Copies `count` cels along the X axis, starting at (srcI, srcJ, srcK) in `src`, to the row starting at (i, j, k).
+    // If `ignoreEmpty` is true, empty cels in `src` don't overwrite anything. The cels must already fit in the storage (see _MakeRoomFor).
+    inline void _CopyRow(int i, int j, int k, const Grid& src, int srcI, int srcJ, int srcK, int count, bool ignoreEmpty = false)
+    {
+        // Palette indices only mean something to the grid they came from, and only rows in the linear layout are stored contiguously.
+        if constexpr (Storage::HAS_PALETTE || !Layout::FLAT_ORDER)
+        {
+            for (int x = 0; x < count; ++x)
+            {
+                const Cel& cel = src._GetCelAt(srcI + x, srcJ, srcK);
+                if (!ignoreEmpty || cel) _ReplaceCel(i + x, j, k, cel);
+            }
+            return;
+        }
+
+        const size_t start = FlatIndex(i, j, k), srcStart = src.FlatIndex(srcI, srcJ, srcK);
+        int delta = 0;
+        size_t n = 0;
+        while (n < (size_t)count)
+        {
+            // Copy the part of the row that is in the same chunk in both grids at once.
+            const size_t offset = (start + n) & (CHUNK_SIZE - 1), srcOffset = (srcStart + n) & (CHUNK_SIZE - 1);
+            const size_t span = std::min({ (size_t)count - n, CHUNK_SIZE - offset, CHUNK_SIZE - srcOffset });
+            const Chunk& srcChunk = *src._chunks[(srcStart + n) >> GRID_CHUNK_BITS];
+            // The chunk is only copied if it's shared once something is actually written to it.
+            Chunk* chunk = nullptr;
+            for (size_t s = 0; s < span; ++s)
+            {
+                const Stored& stored = srcChunk.Get(srcOffset + s);
+                const bool isOccupied = _storage.IsOccupied(stored);
+                if (ignoreEmpty && !isOccupied) continue;
+                if (chunk == nullptr) chunk = &_GetMutableChunk(start + n);
+                if (_storage.IsOccupied(chunk->Get(offset + s)) != isOccupied)
+                {
+                    _xCounts[i + n + s] += isOccupied ? 1 : -1;
+                    delta += isOccupied ? 1 : -1;
+                }
+                chunk->Set(offset + s, stored);
+            }
+            n += span;
+        }
+        if (delta != 0)
+        {
+            _occupiedCount += delta;
+            _layerCounts[j] += delta;
+            _rowCounts[j * _length + k] += delta;
+            _zCounts[k] += delta;
+        }
+    }
+
+    inline void _CountCel(int i, int j, int k, int delta)
+    {
+        _occupiedCount += delta;
+        _layerCounts[j] += delta;
+        _rowCounts[j * _length + k] += delta;
+        _xCounts[i] += delta;
+        _zCounts[k] += delta;
     }
 
-    std::vector<Cel> _grid;
+    // Counts the occupied cels from scratch, for after the cels have been changed directly.
+    inline void _RecountOccupancy()
+    {
+        _occupiedCount = 0;
+        _layerCounts.assign(_height, 0);
+        _rowCounts.assign(_height * _length, 0);
+        _xCounts.assign(_width, 0);
+        _zCounts.assign(_length, 0);
+        for (size_t j = 0; j < _height; ++j)
+        {
+            for (size_t k = 0; k < _length; ++k)
+            {
+                for (size_t i = 0; i < _width; ++i)
+                {
+                    if (_storage.IsOccupied(_GetStoredCel(_StorageIndex(i, j, k)))) _CountCel(i, j, k, 1);
+                }
+            }
+        }
+    }
+
+    static constexpr size_t CHUNK_SIZE = size_t(1) << GRID_CHUNK_BITS;
+    using Stored = typename Storage::Stored;
+    using Chunk = typename Storage::Chunk;
+    // Plain cels are read by reference, and encoded cels are decoded into a new value.
+    using CelRead = decltype(std::declval<const Storage&>().Unpack(std::declval<const Stored&>()));
+
+    inline size_t _StorageIndex(int i, int j, int k) const
+    {
+        return Layout::StorageIndex(i, j, k, _width, _height, _length);
+    }
+
+    inline size_t _StorageIndex(size_t flatIndex) const
+    {
+        if constexpr (Layout::FLAT_ORDER) return flatIndex;
+        Vector3 gridPos = UnflattenIndex(flatIndex);
+        return _StorageIndex((int)gridPos.x, (int)gridPos.y, (int)gridPos.z);
+    }
+
+    inline decltype(auto) _GetStoredCel(size_t storageIndex) const
+    {
+        return _chunks[storageIndex >> GRID_CHUNK_BITS]->Get(storageIndex & (CHUNK_SIZE - 1));
+    }
+
+    // Returns the chunk holding the cel for changing it, first giving this grid its own copy of the chunk if other grids share it.
+    // Chunks are never changed while they are shared.
+    inline Chunk& _GetMutableChunk(size_t storageIndex)
+    {
+        std::shared_ptr<Chunk>& chunk = _chunks[storageIndex >> GRID_CHUNK_BITS];
+        if (chunk.use_count() > 1) chunk = std::make_shared<Chunk>(*chunk);
+        return *chunk;
+    }
+
+    inline CelRead _GetCelAt(size_t flatIndex) const { return _storage.Unpack(_GetStoredCel(_StorageIndex(flatIndex))); }
+    inline CelRead _GetCelAt(int i, int j, int k) const { return _storage.Unpack(_GetStoredCel(_StorageIndex(i, j, k))); }
+
+    // Cels can only be changed in place when they are stored as they are. Otherwise, use _ReplaceCel.
+    inline Cel& _GetMutableCelAt(size_t flatIndex)
+    {
+        static_assert(std::is_same<Stored, Cel>::value, "Encoded cels can't be changed in place");
+        size_t storageIndex = _StorageIndex(flatIndex);
+        return _GetMutableChunk(storageIndex).cels[storageIndex & (CHUNK_SIZE - 1)];
+    }
+
+    inline Cel& _GetMutableCelAt(int i, int j, int k)
+    {
+        static_assert(std::is_same<Stored, Cel>::value, "Encoded cels can't be changed in place");
+        size_t storageIndex = _StorageIndex(i, j, k);
+        return _GetMutableChunk(storageIndex).cels[storageIndex & (CHUNK_SIZE - 1)];
+    }
+
+    Storage _storage;
+    std::vector<std::shared_ptr<Chunk>> _chunks;
+    size_t _celCount;
     size_t _width, _height, _length;
     float _spacing;
+
+    size_t _occupiedCount;
+    std::vector<size_t> _layerCounts; // Occupied cels in each layer along the Y axis
+    std::vector<size_t> _rowCounts; // Occupied cels in each row along the X axis, indexed by j * length + k
+    std::vector<size_t> _xCounts; // Occupied cels in each slice across the X axis
+    std::vector<size_t> _zCounts; // Occupied cels in each slice across the Z axis
 };
 
 #endif
@@ -26,7 +26,7 @@
 
 #include <fstream>
 #include <iostream>
-#include <limits>
+#include <algorithm>
 
 #include "../app.hpp"
 #include "../assets.hpp"
@@ -89,29 +89,29 @@ void MapMan::ExpandMap(Direction axis, int amount)
 //Reduces the size of the grid until it fits perfectly around all the non-empty cels in the map.
 void MapMan::ShrinkMap()
 {
+    // Both grids keep track of where their occupied cels are, so the cels don't need to be searched.
     size_t minX, minY, minZ;
     size_t maxX, maxY, maxZ;
-    minX = minY = minZ = std::numeric_limits<size_t>::max();
-    maxX = maxY = maxZ = 0;
-    for (size_t x = 0; x < _tileGrid.GetWidth(); ++x)
+    bool hasTiles = _tileGrid.GetOccupiedBounds(minX, minY, minZ, maxX, maxY, maxZ);
+
+    size_t entMinX, entMinY, entMinZ;
+    size_t entMaxX, entMaxY, entMaxZ;
+    if (_entGrid.GetOccupiedBounds(entMinX, entMinY, entMinZ, entMaxX, entMaxY, entMaxZ))
     {
-        for (size_t y = 0; y < _tileGrid.GetHeight(); ++y)
+        if (hasTiles)
         {
-            for (size_t z = 0; z < _tileGrid.GetLength(); ++z)
-            {
-                if (_tileGrid.GetTile(x, y, z) || _entGrid.HasEnt(x, y, z))
-                {
-                    if (x < minX) minX = x;
-                    if (y < minY) minY = y;
-                    if (z < minZ) minZ = z;
-                    if (x > maxX) maxX = x;
-                    if (y > maxY) maxY = y;
-                    if (z > maxZ) maxZ = z;
-                }
-            }
+            minX = std::min(minX, entMinX); minY = std::min(minY, entMinY); minZ = std::min(minZ, entMinZ);
+            maxX = std::max(maxX, entMaxX); maxY = std::max(maxY, entMaxY); maxZ = std::max(maxZ, entMaxZ);
+        }
+        else
+        {
+            minX = entMinX; minY = entMinY; minZ = entMinZ;
+            maxX = entMaxX; maxY = entMaxY; maxZ = entMaxZ;
         }
+        hasTiles = true;
     }
-    if (minX > maxX || minY > maxY || minZ > maxZ)
+
+    if (!hasTiles)
     {
         //If there aren't any tiles, just make it 1x1x1.
         _tileGrid = TileGrid(*this, 1, 1, 1);
@@ -163,12 +163,15 @@ bool MapMan::SaveTE3Map(fs::path filePath)
         jData["tiles"]["textures"] = usedTexPaths;
         jData["tiles"]["shapes"] = usedModelPaths;
 
-        // Make a copy of the map that reassigns all IDs to match the new lists
+        // Make a copy of the map that reassigns all IDs to match the new lists.
+        // The copy shares its tile data with the map, so only the parts with tiles whose IDs change get duplicated.
         const int tileArea = _tileGrid.GetWidth() * _tileGrid.GetHeight() * _tileGrid.GetLength();
         TileGrid optimizedGrid = _tileGrid.Subsection(0, 0, 0, _tileGrid.GetWidth(), _tileGrid.GetHeight(), _tileGrid.GetLength());
         for (int gridIdx = 0; gridIdx < tileArea; ++gridIdx)
         {
-            Tile tile = optimizedGrid.GetTile(gridIdx);
+            const Tile oldTile = optimizedGrid.GetTile(gridIdx);
+            if (!oldTile) continue;
+            Tile tile = oldTile;
             for (size_t t = 0; t < usedTexIDs.size(); ++t)
             {
                 for (int i = 0; i < TEXTURES_PER_TILE; ++i)
@@ -187,7 +190,10 @@ bool MapMan::SaveTE3Map(fs::path filePath)
                     break;
                 }
             }
-            optimizedGrid.SetTile(gridIdx, tile);
+            if (tile != oldTile && !optimizedGrid.SetTile(gridIdx, tile))
+            {
+                throw std::runtime_error("The map has too many different tiles to save");
+            }
         }
 
         // Save the modified tile data
@@ -256,6 +262,7 @@ bool MapMan::LoadTE3Map(fs::path filePath)
         
         //Replace our textures with the listed ones
         std::vector<std::string> texturePaths = tiles["textures"];
+        if (texturePaths.size() > TILE_ID_LIMIT) throw std::runtime_error("Map has more textures than tiles can refer to");
         _textureList.clear();
         _textureList.reserve(texturePaths.size());
         for (const std::string& path : texturePaths)
@@ -265,6 +272,7 @@ bool MapMan::LoadTE3Map(fs::path filePath)
 
         //Same with models
         std::vector<std::string> shapePaths = tiles["shapes"];
+        if (shapePaths.size() > TILE_ID_LIMIT) throw std::runtime_error("Map has more shapes than tiles can refer to");
         _modelList.clear();
         _modelList.reserve(shapePaths.size());
         for (const std::string& path : shapePaths)
@@ -336,6 +344,11 @@ TexID MapMan::GetOrAddTexID(const fs::path &texturePath)
         }
     }
     //Create new ID and append texture to list
+    if (_textureList.size() >= TILE_ID_LIMIT)
+    {
+        std::cout << "Cannot add texture " << texturePath << ", since the map has too many textures." << std::endl;
+        return NO_TEX;
+    }
     TexID newID = _textureList.size();
     _textureList.push_back(Assets::GetTexture(texturePath));
     return newID;
@@ -352,6 +365,11 @@ ModelID MapMan::GetOrAddModelID(const fs::path &modelPath)
         }
     }
     //Create new ID and append texture to list
+    if (_modelList.size() >= TILE_ID_LIMIT)
+    {
+        std::cout << "Cannot add shape " << modelPath << ", since the map has too many shapes." << std::endl;
+        return NO_MODEL;
+    }
     ModelID newID = _modelList.size();
     _modelList.push_back(Assets::GetModel(modelPath));
     return newID;
@@ -405,7 +423,11 @@ void MapMan::Undo()
 {
     if (!_undoHistory.empty())
     {
-        _undoHistory.back()->Undo(*this);
+        if (!_undoHistory.back()->Undo(*this))
+        {
+            App::Get()->DisplayStatusMessage("ERROR: The map has too many different tiles to undo this.", 5.0f, 100);
+            return;
+        }
         _redoHistory.push_back(_undoHistory.back());
         _undoHistory.pop_back();
         --_numberOfChanges;
@@ -416,21 +438,30 @@ void MapMan::Redo()
 {
     if (!_redoHistory.empty())
     {
-        _redoHistory.back()->Do(*this);
+        if (!_redoHistory.back()->Do(*this))
+        {
+            App::Get()->DisplayStatusMessage("ERROR: The map has too many different tiles to redo this.", 5.0f, 100);
+            return;
+        }
         _undoHistory.push_back(_redoHistory.back());
         _redoHistory.pop_back();
         ++_numberOfChanges;
     }
 }
 
-void MapMan::_Execute(std::shared_ptr<Action> action)
+bool MapMan::_Execute(std::shared_ptr<Action> action)
 {
+    if (!action->Do(*this))
+    {
+        App::Get()->DisplayStatusMessage("ERROR: The map has too many different tiles to do this.", 5.0f, 100);
+        return false;
+    }
     _undoHistory.push_back(action);
     while (_undoHistory.size() > App::Get()->GetUndoMax()) 
     {
         _undoHistory.pop_front();
     }
     _redoHistory.clear();
-    _undoHistory.back()->Do(*this);
     ++_numberOfChanges;
+    return true;
 }
\ No newline at end of file
@@ -39,8 +39,9 @@ public:
     class Action 
     {
     public:
-        virtual void Do(MapMan &map) const = 0;
-        virtual void Undo(MapMan &map) const = 0;
+        // These return false if the map couldn't be changed, in which case nothing is changed.
+        virtual bool Do(MapMan &map) const = 0;
+        virtual bool Undo(MapMan &map) const = 0;
     };
 
     class TileAction : public Action
@@ -48,8 +49,8 @@ public:
     public:
         TileAction(size_t i, size_t j, size_t k, TileGrid prevState, TileGrid newState);
         
-        virtual void Do(MapMan& map) const override;
-        virtual void Undo(MapMan& map) const override;
+        virtual bool Do(MapMan& map) const override;
+        virtual bool Undo(MapMan& map) const override;
 
         size_t _i, _j, _k;
         TileGrid _prevState;
@@ -61,8 +62,8 @@ public:
     public:
         EntAction(size_t i, size_t j, size_t k, bool overwrite, bool removed, Ent oldEnt, Ent newEnt);
 
-        virtual void Do(MapMan &map) const override;
-        virtual void Undo(MapMan &map) const override;
+        virtual bool Do(MapMan &map) const override;
+        virtual bool Undo(MapMan &map) const override;
     protected:
         size_t _i, _j, _k;
         bool _overwrite; //Indicates if there was an entity underneath the one placed that must be restored when undoing.
@@ -71,6 +72,21 @@ public:
         Ent  _newEnt;
     };
 
+    // Changes scattered rows of tiles, where each row is filled with one tile before and after. 
+    // Only the rows are stored, so it stays small for big, irregular areas.
+    class TileRunAction : public Action
+    {
+    public:
+        TileRunAction(std::vector<TileRun> runs, std::vector<Tile> prevTiles, std::vector<Tile> newTiles);
+
+        virtual bool Do(MapMan &map) const override;
+        virtual bool Undo(MapMan &map) const override;
+    protected:
+        std::vector<TileRun> _runs;
+        std::vector<Tile> _prevTiles; // The tile that each run was filled with before.
+        std::vector<Tile> _newTiles; // The tile that each run is filled with after.
+    };
+
     MapMan();
 
     void NewMap(int width, int height, int length);
@@ -96,15 +112,60 @@ public:
     //Loads and converts a Total Invasion II .ti map from the given path. Returns false on error.
     bool LoadTE2Map(fs::path filePath);
 
+    struct ExportOptions
+    {
+        //If true, then the geometry will be put into separate GLTF nodes according to their tile texture.
+        bool separateGeometry;
+        //If true, faces that are hidden between tiles are removed.
+        bool cullFaces;
+        //If greater than zero, the map is split into cubes of this many cels, and each one with geometry gets its own node.
+        int chunkSize;
+        //If true, adjacent coplanar square faces are combined into larger rectangles with repeating texture coordinates.
+        bool mergeFaces;
+        //If true, duplicate vertices are combined and the triangles are reordered to make better use of the GPU's vertex cache.
+        bool optimizeMeshes;
+        //If true, the tile geometry's vertex attributes are packed into small integers with KHR_mesh_quantization.
+        bool quantize;
+        //If true, the textures used by the tile geometry are packed into atlas images saved next to the exported file.
+        bool atlasTextures;
+        //If true, a separate node with simplified geometry for physics is added. Full cubes are merged into boxes.
+        bool collision;
+        //If true, each combination of shape and texture is exported once and placed at every tile using EXT_mesh_gpu_instancing,
+        //instead of baking all of the tiles into one mesh. The options above that change the baked geometry, and ambientOcclusion, are ignored.
+        bool instanceTiles;
+        //If true, the tile geometry gets vertex colors (COLOR_0) darkened by the tiles around each vertex. Disables face merging.
+        bool ambientOcclusion;
+        //If true, a navigation grid (see ExportNavGrid) is saved next to the exported file with the .nav extension.
+        bool navGrid;
+        //If true, the navigation grid includes a heightfield.
+        bool navHeightfield;
+    };
+
     //Exports the map as a .gltf file, returning false on error.
-    //If separateGeometry is true, then the geometry will be put into separate
-    //GLTF nodes according to their tile texture.
-    bool ExportGLTFScene(fs::path filePath, bool separateGeometry);
+    bool ExportGLTFScene(fs::path filePath, ExportOptions options);
+
+    //Writes a binary file with the occupied cels of the map and the shape and orientation of each one, returning false on error.
+    //When `includeHeightfield` is true, the height that can be stood on in each column is added.
+    //The layout is described above MapMan::ExportNavGrid in map_man_export.cpp.
+    bool ExportNavGrid(fs::path filePath, bool includeHeightfield);
 
     //Executes a undoable tile action for filling an area with one tile
     void ExecuteTileAction(size_t i, size_t j, size_t k, size_t w, size_t h, size_t l, Tile newTile);
     //Executes a undoable tile action for filling an area using a brush
     void ExecuteTileAction(size_t i, size_t j, size_t k, size_t w, size_t h, size_t l, TileGrid brush);
+    //Executes an undoable action that replaces the tiles connected to (i, j, k) that are the same as it, within the given y coordinate range.
+    //If `diagonals` is true, tiles touching at their edges and corners are connected too. Returns the number of tiles that were changed.
+    size_t ExecuteFloodFill(int i, int j, int k, Tile newTile, bool diagonals, int fromY, int toY);
+    //Executes an undoable action that changes `oldID` to `newID` in every tile inside of the rectangular prism with a corner at (i, j, k) and size (w, h, l).
+    //The IDs are ModelIDs when `target` is SHAPE, and TexIDs otherwise. TEXTURES changes both texture slots. Returns the number of tiles that were changed.
+    size_t ExecuteTileReplace(ReplaceTarget target, int16_t oldID, int16_t newID, size_t i, size_t j, size_t k, size_t w, size_t h, size_t l);
+    //Executes an undoable action that rotates or mirrors the tiles inside of the rectangular prism with a corner at (i, j, k) and size (w, h, l) around its center.
+    //The box is changed to where the tiles ended up, which is pushed back inside the grid if it would stick out.
+    //Returns false without changing anything if the turned box is bigger than the grid, or if no tiles were changed.
+    bool ExecuteTileTransform(int& i, int& j, int& k, int& w, int& h, int& l, TileTransform transform);
+    //Executes an undoable action that moves the tiles inside of the rectangular prism by (dx, dy, dz), updating the box's corner.
+    //Returns false without moving anything if the box would leave the grid or no tiles were changed.
+    bool ExecuteTileMove(int& i, int& j, int& k, int w, int h, int l, int dx, int dy, int dz);
     //Executes an undoable entity action for placing an entity
     void ExecuteEntPlacement(int i, int j, int k, Ent newEnt);
     //Executes an undoable entity action for removing an entity.
@@ -138,7 +199,12 @@ public:
     // Returns true if the currently loaded map is going to be converted to the new format on save.
     inline bool WillConvert() const { return _willConvert; }
 private:
-    void _Execute(std::shared_ptr<Action> action);
+    // Does the action and adds it to the undo history. Returns false, showing an error, if the action couldn't be done.
+    bool _Execute(std::shared_ptr<Action> action);
+    //Moves the tiles in a box so that its corner is at (newI, newJ, newK), with their positions inside of the box rotated or mirrored by `cellTransform`.
+    //If `turnTiles` is true, the orientation of each tile is changed by `transform`. Empty tiles don't overwrite anything.
+    //Returns false without changing anything if the moved box would not fit inside of the grid.
+    bool _ExecuteTileRelocation(int i, int j, int k, int w, int h, int l, int newI, int newJ, int newK, Matrix cellTransform, bool turnTiles, TileTransform transform);
 
     TileGrid _tileGrid;
     EntGrid _entGrid;
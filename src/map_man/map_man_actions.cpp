@@ -20,6 +20,12 @@
 
 #include "map_man.hpp"
 
+#include "../parallel.hpp"
+#include "../app.hpp"
+
+// Number of rows of tiles along the X axis that each thread scans at a time when replacing tiles.
+#define REPLACE_BAND_ROWS 16
+
 // ======================================================================
 // TILE ACTION
 // ======================================================================
@@ -30,14 +36,14 @@ MapMan::TileAction::TileAction(size_t i, size_t j, size_t k, TileGrid prevState,
     _newState(newState)
 {}
 
-void MapMan::TileAction::Do(MapMan& map) const
+bool MapMan::TileAction::Do(MapMan& map) const
 {
-    map._tileGrid.CopyTiles(_i, _j, _k, _newState);
+    return map._tileGrid.CopyTiles(_i, _j, _k, _newState);
 }
 
-void MapMan::TileAction::Undo(MapMan& map) const
+bool MapMan::TileAction::Undo(MapMan& map) const
 {
-    map._tileGrid.CopyTiles(_i, _j, _k, _prevState);
+    return map._tileGrid.CopyTiles(_i, _j, _k, _prevState);
 }
 
 void MapMan::ExecuteTileAction(size_t i, size_t j, size_t k, size_t w, size_t h, size_t l, Tile newTile)
@@ -60,13 +66,291 @@ void MapMan::ExecuteTileAction(size_t i, size_t j, size_t k, size_t w, size_t h,
         );
 
     TileGrid newState = prevState; //Copy the old state and merge the brush into it
-    newState.CopyTiles(0, 0, 0, brush, true);
+    if (!newState.CopyTiles(0, 0, 0, brush, true))
+    {
+        App::Get()->DisplayStatusMessage("ERROR: The map has too many different tiles to do this.", 5.0f, 100);
+        return;
+    }
 
     _Execute(std::static_pointer_cast<Action>(
         std::make_shared<TileAction>(i, j, k, prevState, newState)
     ));
 }
 
+// ======================================================================
+// TILE RUN ACTION
+// ======================================================================
+
+MapMan::TileRunAction::TileRunAction(std::vector<TileRun> runs, std::vector<Tile> prevTiles, std::vector<Tile> newTiles)
+    : _runs(std::move(runs)),
+    _prevTiles(std::move(prevTiles)),
+    _newTiles(std::move(newTiles))
+{}
+
+bool MapMan::TileRunAction::Do(MapMan& map) const
+{
+    if (!map._tileGrid.MakeRoomForTiles(_newTiles)) return false;
+    for (size_t r = 0; r < _runs.size(); ++r)
+    {
+        map._tileGrid.SetTileRun(_runs[r].start, _runs[r].count, _newTiles[r]);
+    }
+    return true;
+}
+
+bool MapMan::TileRunAction::Undo(MapMan& map) const
+{
+    if (!map._tileGrid.MakeRoomForTiles(_prevTiles)) return false;
+    for (size_t r = 0; r < _runs.size(); ++r)
+    {
+        map._tileGrid.SetTileRun(_runs[r].start, _runs[r].count, _prevTiles[r]);
+    }
+    return true;
+}
+
+size_t MapMan::ExecuteFloodFill(int i, int j, int k, Tile newTile, bool diagonals, int fromY, int toY)
+{
+    std::vector<TileRun> runs = _tileGrid.FindConnectedRuns(i, j, k, diagonals, fromY, toY);
+    if (runs.empty()) return 0;
+
+    // Every tile in the region matched the first one.
+    Tile prevTile = _tileGrid.GetTile(i, j, k);
+    if (prevTile == newTile || (!prevTile && !newTile)) return 0;
+
+    size_t count = 0;
+    for (const TileRun& run : runs) count += run.count;
+
+    std::vector<Tile> prevTiles(runs.size(), prevTile);
+    std::vector<Tile> newTiles(runs.size(), newTile);
+    if (!_Execute(std::static_pointer_cast<Action>(
+        std::make_shared<TileRunAction>(std::move(runs), std::move(prevTiles), std::move(newTiles))
+    ))) return 0;
+    return count;
+}
+
+size_t MapMan::ExecuteTileReplace(ReplaceTarget target, int16_t oldID, int16_t newID, size_t i, size_t j, size_t k, size_t w, size_t h, size_t l)
+{
+    if (oldID == newID || i >= _tileGrid.GetWidth() || j >= _tileGrid.GetHeight() || k >= _tileGrid.GetLength()) return 0;
+    w = Min(w, _tileGrid.GetWidth() - i);
+    h = Min(h, _tileGrid.GetHeight() - j);
+    l = Min(l, _tileGrid.GetLength() - k);
+
+    // Changes the tile if it matches, returning false otherwise.
+    auto replace = [&](Tile& tile)->bool
+    {
+        if (!tile) return false;
+        bool matched = false;
+        if (target == ReplaceTarget::SHAPE)
+        {
+            matched = (tile.shape == oldID);
+            if (matched) tile.shape = newID;
+            return matched;
+        }
+        for (int t = 0; t < TEXTURES_PER_TILE; ++t)
+        {
+            if ((target == ReplaceTarget::PRIMARY_TEXTURE && t != 0) || (target == ReplaceTarget::SECONDARY_TEXTURE && t != 1)) continue;
+            if (tile.textures[t] != oldID) continue;
+            tile.textures[t] = newID;
+            matched = true;
+        }
+        return matched;
+    };
+
+    // Each layer is split into bands of rows that are scanned in parallel. The grid is only read from during this.
+    struct Band
+    {
+        std::vector<TileRun> runs;
+        std::vector<Tile> prevTiles, newTiles;
+    };
+    const size_t bandsPerLayer = (l + REPLACE_BAND_ROWS - 1) / REPLACE_BAND_ROWS;
+    std::vector<Band> bands(h * bandsPerLayer);
+    ParallelFor(bands.size(), [&](size_t b)
+    {
+        Band& band = bands[b];
+        size_t y = j + b / bandsPerLayer;
+        size_t zStart = k + (b % bandsPerLayer) * REPLACE_BAND_ROWS;
+        size_t zEnd = Min(zStart + REPLACE_BAND_ROWS, k + l);
+        for (size_t z = zStart; z < zEnd; ++z)
+        {
+            size_t rowStart = _tileGrid.FlatIndex(i, y, z);
+            for (size_t x = 0; x < w; ++x)
+            {
+                Tile tile = _tileGrid.GetTile(rowStart + x);
+                Tile newTile = tile;
+                if (!replace(newTile)) continue;
+
+                // Neighboring tiles that were the same become one run.
+                if (!band.runs.empty() && band.runs.back().start + band.runs.back().count == rowStart + x && band.prevTiles.back() == tile)
+                {
+                    ++band.runs.back().count;
+                    continue;
+                }
+                band.runs.push_back(TileRun { rowStart + x, 1 });
+                band.prevTiles.push_back(tile);
+                band.newTiles.push_back(newTile);
+            }
+        }
+    });
+
+    std::vector<TileRun> runs;
+    std::vector<Tile> prevTiles, newTiles;
+    size_t count = 0;
+    for (Band& band : bands)
+    {
+        for (const TileRun& run : band.runs) count += run.count;
+        runs.insert(runs.end(), band.runs.begin(), band.runs.end());
+        prevTiles.insert(prevTiles.end(), band.prevTiles.begin(), band.prevTiles.end());
+        newTiles.insert(newTiles.end(), band.newTiles.begin(), band.newTiles.end());
+    }
+    if (runs.empty()) return 0;
+
+    if (!_Execute(std::static_pointer_cast<Action>(
+        std::make_shared<TileRunAction>(std::move(runs), std::move(prevTiles), std::move(newTiles))
+    ))) return 0;
+    return count;
+}
+
+bool MapMan::ExecuteTileTransform(int& i, int& j, int& k, int& w, int& h, int& l, TileTransform transform)
+{
+    if (i < 0 || j < 0 || k < 0 || w <= 0 || h <= 0 || l <= 0) return false;
+    w = Min(w, (int)_tileGrid.GetWidth() - i);
+    h = Min(h, (int)_tileGrid.GetHeight() - j);
+    l = Min(l, (int)_tileGrid.GetLength() - k);
+    if (w <= 0 || h <= 0 || l <= 0) return false;
+
+    // The size of the box after turning it is found by transforming its extents.
+    Matrix cellTransform = TileTransformMatrix(transform);
+    Vector3 newSize = Vector3Transform(Vector3 { (float)w, (float)h, (float)l }, cellTransform);
+    int newW = (int)roundf(fabsf(newSize.x));
+    int newH = (int)roundf(fabsf(newSize.y));
+    int newL = (int)roundf(fabsf(newSize.z));
+    if (newW > (int)_tileGrid.GetWidth() || newH > (int)_tileGrid.GetHeight() || newL > (int)_tileGrid.GetLength()) return false;
+
+    // Keep the center where it was, unless that puts part of the box outside of the grid.
+    int newI = Max(0, Min(i + (w - newW) / 2, (int)_tileGrid.GetWidth() - newW));
+    int newJ = Max(0, Min(j + (h - newH) / 2, (int)_tileGrid.GetHeight() - newH));
+    int newK = Max(0, Min(k + (l - newL) / 2, (int)_tileGrid.GetLength() - newL));
+
+    if (!_ExecuteTileRelocation(i, j, k, w, h, l, newI, newJ, newK, cellTransform, true, transform)) return false;
+
+    i = newI;
+    j = newJ;
+    k = newK;
+    w = newW;
+    h = newH;
+    l = newL;
+    return true;
+}
+
+bool MapMan::ExecuteTileMove(int& i, int& j, int& k, int w, int h, int l, int dx, int dy, int dz)
+{
+    if (i + dx < 0 || j + dy < 0 || k + dz < 0 || w <= 0 || h <= 0 || l <= 0
+        || i + dx + w > (int)_tileGrid.GetWidth() || j + dy + h > (int)_tileGrid.GetHeight() || k + dz + l > (int)_tileGrid.GetLength()) 
+    {
+        return false;
+    }
+
+    if (!_ExecuteTileRelocation(i, j, k, w, h, l, i + dx, j + dy, k + dz, MatrixIdentity(), false, TileTransform::ROTATE_CW)) return false;
+
+    i += dx;
+    j += dy;
+    k += dz;
+    return true;
+}
+
+bool MapMan::_ExecuteTileRelocation(int i, int j, int k, int w, int h, int l, int newI, int newJ, int newK, Matrix cellTransform, bool turnTiles, TileTransform transform)
+{
+    Vector3 newSize = Vector3Transform(Vector3 { (float)w, (float)h, (float)l }, cellTransform);
+    int newW = (int)roundf(fabsf(newSize.x));
+    int newH = (int)roundf(fabsf(newSize.y));
+    int newL = (int)roundf(fabsf(newSize.z));
+
+    // Tiles that would land outside of the grid would be lost, so the whole operation is refused instead.
+    if (newI < 0 || newJ < 0 || newK < 0 
+        || newI + newW > (int)_tileGrid.GetWidth() || newJ + newH > (int)_tileGrid.GetHeight() || newK + newL > (int)_tileGrid.GetLength())
+    {
+        return false;
+    }
+
+    // Both the old and new positions of the tiles fit inside of this box, which is all that can change.
+    int minI = Min(i, newI), minJ = Min(j, newJ), minK = Min(k, newK);
+    int maxI = Max(i + w, newI + newW), maxJ = Max(j + h, newJ + newH), maxK = Max(k + l, newK + newL);
+    int areaW = maxI - minI, areaH = maxJ - minJ, areaL = maxK - minK;
+    auto areaIndex = [&](int x, int y, int z)->size_t
+    {
+        return (size_t)(x - minI) + (size_t)(z - minK) * areaW + (size_t)(y - minJ) * areaW * areaL;
+    };
+
+    std::vector<Tile> prevArea((size_t)areaW * areaH * areaL);
+    for (int y = minJ; y < maxJ; ++y)
+    {
+        for (int z = minK; z < maxK; ++z)
+        {
+            size_t rowStart = _tileGrid.FlatIndex(minI, y, z);
+            for (int x = 0; x < areaW; ++x) prevArea[areaIndex(minI + x, y, z)] = _tileGrid.GetTile(rowStart + x);
+        }
+    }
+
+    // Clear the old box, then put each tile where its position relative to the box's center is taken by the transform.
+    // Positions are doubled so that the centers of boxes with even sizes are still whole numbers.
+    std::vector<Tile> newArea = prevArea;
+    for (int y = j; y < j + h; ++y)
+        for (int z = k; z < k + l; ++z)
+            for (int x = i; x < i + w; ++x)
+                newArea[areaIndex(x, y, z)] = Tile();
+
+    for (int y = 0; y < h; ++y)
+    {
+        for (int z = 0; z < l; ++z)
+        {
+            for (int x = 0; x < w; ++x)
+            {
+                Tile tile = prevArea[areaIndex(i + x, j + y, k + z)];
+                if (!tile) continue;
+
+                Vector3 offset = Vector3Transform(Vector3 { float(2 * x - (w - 1)), float(2 * y - (h - 1)), float(2 * z - (l - 1)) }, cellTransform);
+                int destI = newI + ((int)roundf(offset.x) + newW - 1) / 2;
+                int destJ = newJ + ((int)roundf(offset.y) + newH - 1) / 2;
+                int destK = newK + ((int)roundf(offset.z) + newL - 1) / 2;
+
+                newArea[areaIndex(destI, destJ, destK)] = turnTiles ? TransformTile(tile, transform) : tile;
+            }
+        }
+    }
+
+    // Only the tiles that changed are recorded, with neighboring tiles that changed the same way sharing a run.
+    auto same = [](const Tile& a, const Tile& b) { return a == b || (!a && !b); };
+    std::vector<TileRun> runs;
+    std::vector<Tile> prevTiles, newTiles;
+    for (int y = minJ; y < maxJ; ++y)
+    {
+        for (int z = minK; z < maxK; ++z)
+        {
+            size_t rowStart = _tileGrid.FlatIndex(minI, y, z);
+            for (int x = 0; x < areaW; ++x)
+            {
+                const Tile& prevTile = prevArea[areaIndex(minI + x, y, z)];
+                const Tile& newTile = newArea[areaIndex(minI + x, y, z)];
+                if (same(prevTile, newTile)) continue;
+
+                if (!runs.empty() && runs.back().start + runs.back().count == rowStart + x 
+                    && same(prevTiles.back(), prevTile) && same(newTiles.back(), newTile))
+                {
+                    ++runs.back().count;
+                    continue;
+                }
+                runs.push_back(TileRun { rowStart + x, 1 });
+                prevTiles.push_back(prevTile);
+                newTiles.push_back(newTile);
+            }
+        }
+    }
+    if (runs.empty()) return false;
+
+    return _Execute(std::static_pointer_cast<Action>(
+        std::make_shared<TileRunAction>(std::move(runs), std::move(prevTiles), std::move(newTiles))
+    ));
+}
+
 // ======================================================================
 // ENT ACTION
 // ======================================================================
@@ -79,7 +363,7 @@ MapMan::EntAction::EntAction(size_t i, size_t j, size_t k, bool overwrite, bool
     _newEnt(newEnt)
 {}
 
-void MapMan::EntAction::Do(MapMan& map) const
+bool MapMan::EntAction::Do(MapMan& map) const
 {
     if (_removed)
     {
@@ -89,9 +373,10 @@ void MapMan::EntAction::Do(MapMan& map) const
     {
         map._entGrid.AddEnt(_i, _j, _k, _newEnt);
     }
+    return true;
 }
 
-void MapMan::EntAction::Undo(MapMan& map) const
+bool MapMan::EntAction::Undo(MapMan& map) const
 {
     if (_overwrite || _removed)
     {
@@ -101,6 +386,7 @@ void MapMan::EntAction::Undo(MapMan& map) const
     {
         map._entGrid.RemoveEnt(_i, _j, _k);
     }
+    return true;
 }
 
 void MapMan::ExecuteEntPlacement(int i, int j, int k, Ent newEnt)
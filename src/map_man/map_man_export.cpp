@@ -27,57 +27,249 @@
 #include <iostream>
 #include <limits>
 #include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 
 #include "../app.hpp"
 #include "../assets.hpp"
 #include "../text_util.hpp"
 #include "../c_helpers.hpp"
+#include "../mesh_ops.hpp"
+#include "../parallel.hpp"
+#include "../texture_atlas.hpp"
 
+#define TARGET_NONE 0
 #define TARGET_ARRAY_BUFFER 34962
 #define TARGET_ELEMENT_BUFFER 34963
-#define COMP_TYPE_FLOAT 5126
+#define COMP_TYPE_BYTE 5120
+#define COMP_TYPE_UBYTE 5121
 #define COMP_TYPE_USHORT 5123
+#define COMP_TYPE_FLOAT 5126
 #define PRIMITIVE_MODE_TRIANGLES 4
 #define FILTER_NEAREST 9728
 #define FILTER_NEAREST_MIP_NEAREST 9984
 #define WRAP_REPEAT 10497
 
-bool MapMan::ExportGLTFScene(fs::path filePath, bool separateGeometry)
+// Number of pixels around each texture in an atlas, which repeat the texture's opposite edges.
+#define ATLAS_GUTTER 8
+// Largest width and height of an atlas page, in pixels. This is the smallest maximum texture size that most GPUs support.
+#define ATLAS_MAX_SIZE 4096
+
+// Number of grid cels along each side of the blocks that collision is generated for in parallel.
+#define COLLISION_BLOCK_SIZE 32
+
+// Number of bytes encoded at a time when streaming the buffer as base64. Must be a multiple of 3.
+#define BASE64_BLOCK_SIZE (3 * 16384)
+
+// A range of the glTF binary buffer that is copied straight out of existing memory when the file is written.
+struct BufferSegment
+{
+    const void* data; // If null, or shorter than the segment, the rest is filled with zeroes.
+    size_t dataLength;
+    size_t byteOffset;
+    size_t byteLength;
+};
+
+// Writes the glTF binary buffer to a stream piece by piece, either as raw bytes (.glb) or as base64 text (.gltf).
+class BufferStreamWriter
+{
+public:
+    BufferStreamWriter(std::ostream& stream, bool base64)
+        : _stream(stream), _base64(base64), _bytesWritten(0)
+    {
+        if (_base64)
+        {
+            _block.reserve(BASE64_BLOCK_SIZE);
+            _encoded.resize(base64::encoded_size(BASE64_BLOCK_SIZE) + 1);
+        }
+    }
+
+    void Write(const void* data, size_t length)
+    {
+        _bytesWritten += length;
+        if (!_base64)
+        {
+            _stream.write(reinterpret_cast<const char*>(data), length);
+            return;
+        }
+
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        while (length > 0)
+        {
+            size_t count = std::min(length, BASE64_BLOCK_SIZE - _block.size());
+            _block.insert(_block.end(), bytes, bytes + count);
+            bytes += count;
+            length -= count;
+            if (_block.size() == BASE64_BLOCK_SIZE) _EncodeBlock();
+        }
+    }
+
+    void WriteZeroes(size_t length)
+    {
+        static const uint8_t ZEROES[256] = { 0 };
+        while (length > 0)
+        {
+            size_t count = std::min(length, sizeof(ZEROES));
+            Write(ZEROES, count);
+            length -= count;
+        }
+    }
+
+    // Writes the segment's data at its offset, filling any gap since the last write with zeroes.
+    void WriteSegment(const BufferSegment& segment)
+    {
+        WriteZeroes(segment.byteOffset - _bytesWritten);
+        size_t dataLength = (segment.data == nullptr) ? 0 : std::min(segment.dataLength, segment.byteLength);
+        if (dataLength > 0) Write(segment.data, dataLength);
+        WriteZeroes(segment.byteLength - dataLength);
+    }
+
+    // Encodes whatever is left over. Must be called once after the last write.
+    void Finish()
+    {
+        if (_base64 && !_block.empty()) _EncodeBlock();
+    }
+
+    inline size_t GetBytesWritten() const { return _bytesWritten; }
+private:
+    void _EncodeBlock()
+    {
+        size_t encodedLength = base64::encode(_encoded.data(), _encoded.size(), _block.data(), _block.size());
+        _stream.write(_encoded.data(), encodedLength);
+        _block.clear();
+    }
+
+    std::ostream& _stream;
+    bool _base64;
+    size_t _bytesWritten;
+    std::vector<uint8_t> _block;
+    std::vector<char> _encoded;
+};
+
+// Integer coordinates that positions are rounded to for KHR_mesh_quantization. 
+// The node holding the mesh is given a transform that maps them back into place.
+struct QuantizationGrid
+{
+    Vector3 origin;
+    float step;
+};
+
+// Finds the smallest power of two step size that fits the bounds into 16 bit coordinates.
+// Since the step and the origin are powers of two, positions that line up with the map's grid stay exact.
+static QuantizationGrid QuantizationGridFromBounds(const BoundingBox& bounds)
+{
+    float extent = Maxf(bounds.max.x - bounds.min.x, Maxf(bounds.max.y - bounds.min.y, bounds.max.z - bounds.min.z));
+    QuantizationGrid grid;
+    grid.step = exp2f(ceilf(log2f(Maxf(extent, 1.0f) / (float)UINT16_MAX)));
+    for (;;)
+    {
+        grid.origin = Vector3 { floorf(bounds.min.x / grid.step), floorf(bounds.min.y / grid.step), floorf(bounds.min.z / grid.step) } * grid.step;
+        Vector3 size = (bounds.max - grid.origin) / grid.step;
+        if (Maxf(size.x, Maxf(size.y, size.z)) <= (float)UINT16_MAX) break;
+        // Rounding the origin down can push the far side out of range.
+        grid.step *= 2.0f;
+    }
+    return grid;
+}
+
+// Adds the 12 triangles of the box's sides to the positions, wound counter-clockwise from the outside.
+static void AppendBoxTriangles(std::vector<float>& positions, const BoundingBox& box)
+{
+    // The bits of each corner's index pick the min or max along X, Y, and Z.
+    Vector3 corners[8];
+    for (int c = 0; c < 8; ++c)
+    {
+        corners[c] = Vector3 { (c & 1) ? box.max.x : box.min.x, (c & 2) ? box.max.y : box.min.y, (c & 4) ? box.max.z : box.min.z };
+    }
+    static const int SIDES[6][4] = {
+        { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, // -X, +X
+        { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, // -Y, +Y
+        { 0, 2, 3, 1 }, { 4, 5, 7, 6 }  // -Z, +Z
+    };
+    for (const auto& side : SIDES)
+    {
+        for (int corner : { side[0], side[1], side[2], side[0], side[2], side[3] })
+        {
+            positions.insert(positions.end(), { corners[corner].x, corners[corner].y, corners[corner].z });
+        }
+    }
+}
+
+// Replaces slashes and dots in the path with underscores. This makes sure the names are imported into Godot without modification.
+static std::string NodeNameFromPath(const fs::path& path)
+{
+    std::string name = path.generic_string();
+    std::replace(name.begin(), name.end(), '/', '_');
+    std::replace(name.begin(), name.end(), '.', '_');
+    return name;
+}
+
+bool MapMan::ExportGLTFScene(fs::path filePath, ExportOptions options)
 {
     using namespace nlohmann;
 
-    const Model mapModel = _tileGrid.GetModel();
-    
     bool isGLB = (strcmp(TextToLower(filePath.extension().string().c_str()), ".glb") == 0);
-    uint8_t* bufferData = nullptr;
 
     bool error = false;
 
+    // These only change the baked tile geometry, which isn't made for instanced tiles.
+    if (options.instanceTiles)
+    {
+        options.separateGeometry = options.cullFaces = options.mergeFaces = options.optimizeMeshes = false;
+        options.quantize = options.atlasTextures = options.ambientOcclusion = false;
+        options.chunkSize = 0;
+    }
+
     try
     {   
         std::vector<json> scenes, nodes, meshes, buffers, bufferViews, accessors, materials, textures, images, samplers;
+        std::vector<std::string> extensionsUsed;
 
         size_t bufferOffset = 0;
 
-        // Automates the addition of bufferViews and accessors for a given vertex attribute
-        auto pushVertexAttrib = [&](size_t elemSize, size_t nElems, std::string elemType, int componentType, int target = TARGET_ARRAY_BUFFER)->size_t
+        // Where each bufferView's data comes from. The buffer is only assembled as it is written to the file.
+        std::vector<BufferSegment> bufferSegments;
+
+        // Holds data generated during the export, which has to stay in memory until the buffer is written.
+        std::deque<std::vector<float>> generatedData;
+        std::deque<std::vector<uint8_t>> packedData; // For attributes that aren't floats
+        std::vector<std::vector<TileMesh>> chunkMeshes;
+
+        // Automates the addition of bufferViews and accessors for a given vertex attribute.
+        // Elements that are bigger than their components add up to (because of padding) give the bufferView a stride.
+        auto pushVertexAttrib = [&](const void* data, size_t elemSize, size_t nElems, std::string elemType, int componentType, 
+            int target = TARGET_ARRAY_BUFFER, bool normalized = false)->size_t
         {
             // Always allocate at least one element's worth of data just to avoid errors
-            size_t nBytes = Max(1, elemSize) * nElems;
+            size_t nBytes = elemSize * Max(1, (int)nElems);
             
-            // Pad the offset so that the total offset of the accessor is divisible by the element size
+            // Pad the offset to a multiple of 4 so that every accessor is aligned to its component size.
             // This is a requirement of the gltf specifications
-            size_t padding = bufferOffset % elemSize;
+            size_t padding = (4 - bufferOffset % 4) % 4;
             bufferOffset += padding;
 
+            bufferSegments.push_back(BufferSegment {
+                data,
+                elemSize * nElems,
+                bufferOffset,
+                nBytes
+            });
+
             size_t newIndex = bufferViews.size();
 
             bufferViews.push_back({
                 {"buffer", 0},
                 {"byteLength", nBytes},
-                {"byteOffset", bufferOffset},
-                {"target", target}
+                {"byteOffset", bufferOffset}
             });
+            if (target != TARGET_NONE) bufferViews.back()["target"] = target;
+
+            size_t componentSize = (componentType == COMP_TYPE_BYTE || componentType == COMP_TYPE_UBYTE) ? 1 : (componentType == COMP_TYPE_USHORT) ? 2 : 4;
+            size_t componentCount = (elemType == "SCALAR") ? 1 : (size_t)(elemType.back() - '0');
+            if (elemSize != componentSize * componentCount) bufferViews.back()["byteStride"] = elemSize;
             
             accessors.push_back({
                 {"bufferView", bufferViews.size() - 1},
@@ -85,64 +277,165 @@ bool MapMan::ExportGLTFScene(fs::path filePath, bool separateGeometry)
                 {"count", nElems},
                 {"type", elemType}
             });
+            if (normalized) accessors.back()["normalized"] = true;
 
             bufferOffset += nBytes;
 
             return newIndex;
         };
         
-        std::vector<json> mapPrims;
-        mapPrims.reserve(mapModel.meshCount);
-
-        // Make primitives and buffer related objects for each mesh of the map
-        for (int i = 0; i < mapModel.meshCount; ++i)
+        // Pushes the vertex attributes and indices of a mesh, returning a primitive without a material.
+        // The bounds of the positions are written to `outMin` and `outMax`.
+        auto pushPrimitive = [&](const float* positions, const float* texCoords, const float* normals, size_t vertexCount, 
+            const unsigned short* indices, size_t indexCount, Vector3& outMin, Vector3& outMax)->json
         {
             // Calculate max and min component values. Required only for position buffer.
-            float minX, minY, minZ;
-            minX = minY = minZ = std::numeric_limits<float>::max();
-            float maxX, maxY, maxZ;
-            maxX = maxY = maxZ = std::numeric_limits<float>::min();
-            for (int j = 0; j < mapModel.meshes[i].vertexCount * 3; j += 3) 
-                minX = Minf(mapModel.meshes[i].vertices[j], minX), maxX = Maxf(mapModel.meshes[i].vertices[j], maxX); 
-            for (int j = 1; j < mapModel.meshes[i].vertexCount * 3; j += 3) 
-                minY = Minf(mapModel.meshes[i].vertices[j], minY), maxY = Maxf(mapModel.meshes[i].vertices[j], maxY); 
-            for (int j = 2; j < mapModel.meshes[i].vertexCount * 3; j += 3) 
-                minZ = Minf(mapModel.meshes[i].vertices[j], minZ), maxZ = Maxf(mapModel.meshes[i].vertices[j], maxZ); 
+            Vector3 min = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+            Vector3 max = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+            for (size_t j = 0; positions != nullptr && j < vertexCount * 3; j += 3)
+            {
+                min = Vector3Min(min, Vector3 { positions[j], positions[j + 1], positions[j + 2] });
+                max = Vector3Max(max, Vector3 { positions[j], positions[j + 1], positions[j + 2] });
+            }
+            outMin = min;
+            outMax = max;
 
             // Push buffers, accessors, etc.
-            size_t posBufferIdx = pushVertexAttrib(sizeof(float) * 3, mapModel.meshes[i].vertexCount, "VEC3", COMP_TYPE_FLOAT);
-            accessors[posBufferIdx]["min"] = {minX, minY, minZ};
-            accessors[posBufferIdx]["max"] = {maxX, maxY, maxZ};
+            size_t posBufferIdx = pushVertexAttrib(positions, sizeof(float) * 3, vertexCount, "VEC3", COMP_TYPE_FLOAT);
+            accessors[posBufferIdx]["min"] = {min.x, min.y, min.z};
+            accessors[posBufferIdx]["max"] = {max.x, max.y, max.z};
 
-            size_t uvBufferIdx = pushVertexAttrib(sizeof(float) * 2, mapModel.meshes[i].vertexCount, "VEC2", COMP_TYPE_FLOAT);
-            size_t normBufferIdx = pushVertexAttrib(sizeof(float) * 3, mapModel.meshes[i].vertexCount, "VEC3", COMP_TYPE_FLOAT);
-            size_t indicesIdx = pushVertexAttrib(sizeof(unsigned short), mapModel.meshes[i].triangleCount * 3, "SCALAR", COMP_TYPE_USHORT, TARGET_ELEMENT_BUFFER);
+            size_t uvBufferIdx = pushVertexAttrib(texCoords, sizeof(float) * 2, vertexCount, "VEC2", COMP_TYPE_FLOAT);
+            size_t normBufferIdx = pushVertexAttrib(normals, sizeof(float) * 3, vertexCount, "VEC3", COMP_TYPE_FLOAT);
 
-            // Push primitive
-            mapPrims.push_back({
+            json primitive = {
+                {"mode", PRIMITIVE_MODE_TRIANGLES},
+                {"attributes", {
+                    {"POSITION", posBufferIdx},
+                    {"TEXCOORD_0", uvBufferIdx},
+                    {"NORMAL", normBufferIdx}
+                }}
+            };
+
+            // Meshes without indices are drawn as plain triangle lists.
+            if (indices != nullptr)
+            {
+                primitive["indices"] = pushVertexAttrib(indices, sizeof(unsigned short), indexCount, "SCALAR", COMP_TYPE_USHORT, TARGET_ELEMENT_BUFFER);
+            }
+
+            return primitive;
+        };
+
+        // Pushes a tile mesh with its attributes packed into integers, for KHR_mesh_quantization. 
+        // Positions are relative to the grid, which the node holding the mesh must be transformed by.
+        auto pushQuantizedPrimitive = [&](const TileMesh& tileMesh, const QuantizationGrid& grid)->json
+        {
+            size_t vertexCount = tileMesh.positions.size() / 3;
+
+            // Positions are unsigned shorts, padded to 8 bytes so that each one is aligned to 4 bytes.
+            std::vector<uint8_t>& positionData = packedData.emplace_back(vertexCount * sizeof(uint16_t) * 4, 0);
+            uint16_t* positions = reinterpret_cast<uint16_t*>(positionData.data());
+            uint16_t min[3] = { UINT16_MAX, UINT16_MAX, UINT16_MAX };
+            uint16_t max[3] = { 0, 0, 0 };
+            const float origin[3] = { grid.origin.x, grid.origin.y, grid.origin.z };
+            for (size_t v = 0; v < vertexCount; ++v)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    float coord = roundf((tileMesh.positions[v * 3 + c] - origin[c]) / grid.step);
+                    uint16_t value = (uint16_t)Clamp(coord, 0.0f, (float)UINT16_MAX);
+                    positions[v * 4 + c] = value;
+                    min[c] = std::min(min[c], value);
+                    max[c] = std::max(max[c], value);
+                }
+            }
+            size_t posBufferIdx = pushVertexAttrib(positions, sizeof(uint16_t) * 4, vertexCount, "VEC3", COMP_TYPE_USHORT);
+            accessors[posBufferIdx]["min"] = {min[0], min[1], min[2]};
+            accessors[posBufferIdx]["max"] = {max[0], max[1], max[2]};
+
+            // Normals are signed normalized bytes, padded to 4 bytes.
+            std::vector<uint8_t>& normalData = packedData.emplace_back(vertexCount * 4, 0);
+            int8_t* normals = reinterpret_cast<int8_t*>(normalData.data());
+            for (size_t v = 0; v < vertexCount; ++v)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    normals[v * 4 + c] = (int8_t)Clamp(roundf(tileMesh.normals[v * 3 + c] * 127.0f), -127.0f, 127.0f);
+                }
+            }
+            size_t normBufferIdx = pushVertexAttrib(normals, 4, vertexCount, "VEC3", COMP_TYPE_BYTE, TARGET_ARRAY_BUFFER, true);
+
+            // Texture coordinates can only be packed as normalized unsigned shorts if they are between 0 and 1.
+            // Otherwise (which merged faces cause) they would need a texture transform, so they are left as floats.
+            bool uvsInRange = std::all_of(tileMesh.texCoords.begin(), tileMesh.texCoords.end(), [](float uv){ return uv >= 0.0f && uv <= 1.0f; });
+            size_t uvBufferIdx = 0;
+            if (uvsInRange)
+            {
+                std::vector<uint8_t>& uvData = packedData.emplace_back(vertexCount * sizeof(uint16_t) * 2, 0);
+                uint16_t* uvs = reinterpret_cast<uint16_t*>(uvData.data());
+                for (size_t i = 0; i < vertexCount * 2; ++i)
+                {
+                    uvs[i] = (uint16_t)roundf(tileMesh.texCoords[i] * (float)UINT16_MAX);
+                }
+                uvBufferIdx = pushVertexAttrib(uvs, sizeof(uint16_t) * 2, vertexCount, "VEC2", COMP_TYPE_USHORT, TARGET_ARRAY_BUFFER, true);
+            }
+            else
+            {
+                uvBufferIdx = pushVertexAttrib(tileMesh.texCoords.data(), sizeof(float) * 2, vertexCount, "VEC2", COMP_TYPE_FLOAT);
+            }
+
+            return {
                 {"mode", PRIMITIVE_MODE_TRIANGLES},
                 {"attributes", {
                     {"POSITION", posBufferIdx},
                     {"TEXCOORD_0", uvBufferIdx},
                     {"NORMAL", normBufferIdx}
                 }},
-                {"indices", indicesIdx},
-                {"material", i}
-            });
-        }
+                {"indices", pushVertexAttrib(tileMesh.indices.data(), sizeof(unsigned short), tileMesh.indices.size(), "SCALAR", COMP_TYPE_USHORT, TARGET_ELEMENT_BUFFER)}
+            };
+        };
 
-        // Indices for child nodes of the root map node
-        std::vector<int> mapNodeChildren;
+        // Pushes the tile mesh's vertex colors, returning the accessor for COLOR_0.
+        // When quantizing, they are packed into normalized unsigned bytes with an opaque alpha channel to keep them 4 byte aligned.
+        auto pushVertexColors = [&](const TileMesh& tileMesh)->size_t
+        {
+            size_t vertexCount = tileMesh.colors.size() / 3;
+            if (!options.quantize)
+            {
+                return pushVertexAttrib(tileMesh.colors.data(), sizeof(float) * 3, vertexCount, "VEC3", COMP_TYPE_FLOAT);
+            }
+
+            std::vector<uint8_t>& colorData = packedData.emplace_back(vertexCount * 4, UINT8_MAX);
+            for (size_t v = 0; v < vertexCount; ++v)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    colorData[v * 4 + c] = (uint8_t)Clamp(roundf(tileMesh.colors[v * 3 + c] * 255.0f), 0.0f, 255.0f);
+                }
+            }
+            return pushVertexAttrib(colorData.data(), 4, vertexCount, "VEC4", COMP_TYPE_UBYTE, TARGET_ARRAY_BUFFER, true);
+        };
 
-        // Encode materials and textures
-        for (int m = 0; m < mapModel.meshCount; ++m)
+        // Gives the node the transform that maps the quantization grid's coordinates back into place.
+        auto setQuantizationTransform = [](json& node, const QuantizationGrid& grid)
+        {
+            node["translation"] = { grid.origin.x, grid.origin.y, grid.origin.z };
+            node["scale"] = { grid.step, grid.step, grid.step };
+        };
+
+        // Indices of the materials for each texture that has been used so far
+        std::map<TexID, size_t> materialIndices;
+
+        // Pushes a material with its texture and image, returning the material's index.
+        auto pushMaterial = [&](const fs::path& imagePath)->size_t
         {
             // Image paths in the GLTF are relative to the file.
-            fs::path imagePath = PathFromTexID(mapModel.meshMaterial[m]);
             fs::path imagePathFromGLTF = fs::relative(
                 fs::current_path() / imagePath, 
                 fs::current_path() / filePath.parent_path()); 
             
+            size_t materialIndex = materials.size();
+
             // Push material
             materials.push_back({
                 {"name", imagePathFromGLTF.generic_string()},
@@ -167,111 +460,517 @@ bool MapMan::ExportGLTFScene(fs::path filePath, bool separateGeometry)
                 {"uri", imagePathFromGLTF.generic_string()}
             });
 
-            if (separateGeometry)
+            return materialIndex;
+        };
+
+        // Returns the index of the texture's material, pushing a new one the first time it is used.
+        auto getMaterial = [&](TexID texID)->size_t
+        {
+            auto iter = materialIndices.find(texID);
+            if (iter != materialIndices.end()) return iter->second;
+
+            size_t materialIndex = pushMaterial(PathFromTexID(texID));
+            materialIndices[texID] = materialIndex;
+            return materialIndex;
+        };
+
+        // When the textures are baked into atlases, the tile meshes' texture IDs are replaced with atlas page numbers.
+        std::vector<size_t> atlasMaterials;
+        std::vector<std::string> atlasNodeNames;
+
+        // Returns the texture's path relative to the textures directory, as a node name.
+        auto textureNodeName = [&](TexID texID)->std::string
+        {
+            return NodeNameFromPath(fs::relative(fs::current_path() / PathFromTexID(texID), fs::current_path() / App::Get()->GetTexturesDir()));
+        };
+
+        json mapNode = {{"name", "map"}};
+
+        // Indices for child nodes of the root map node
+        std::vector<int> mapNodeChildren;
+
+        // Number of triangles in the tile geometry after culling, to compare the collision against.
+        size_t renderTriangleCount = 0;
+
+        // Gives the node the meshes' geometry, either as one mesh or as child nodes for each texture when separate geometry is enabled.
+        // Returns the bounds of the geometry.
+        auto addTileMeshes = [&](json& node, const std::vector<TileMesh>& tileMeshes)->BoundingBox
+        {
+            BoundingBox bounds = { 
+                Vector3 { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() }, 
+                Vector3 { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() }
+            };
+            std::vector<BoundingBox> meshBounds;
+            for (const TileMesh& tileMesh : tileMeshes)
             {
-                // When separate geometry is enabled, each material gets its own node containing its portion of the map geometry
-                std::string nodeName = fs::relative(fs::current_path() / imagePath, fs::current_path() / App::Get()->GetTexturesDir()).generic_string();
-                
-                // The compiler thinks this is necessary, apparently... 9_9
-                char nodeNameBuffer[nodeName.length() + 1];
-                memcpy(nodeNameBuffer, nodeName.data(), nodeName.length() + 1);
-                // Replace slashes from the path with underscores. This makes sure the names are imported into Godot without modification.
-                char* newNodeName = TextReplace(nodeNameBuffer, "/", "_");
-                char* finalNodeName = TextReplace(newNodeName, ".", "_");
-
-                json materialNode = {{"name", std::string(finalNodeName)}};
-
-                free(newNodeName);
-                free(finalNodeName);
-
-                json mesh = {
-                    {"primitives", {mapPrims[m]}}
-                };
+                BoundingBox& box = meshBounds.emplace_back(bounds); // Starts out empty
+                for (size_t j = 0; j < tileMesh.positions.size(); j += 3)
+                {
+                    box.min = Vector3Min(box.min, Vector3 { tileMesh.positions[j], tileMesh.positions[j + 1], tileMesh.positions[j + 2] });
+                    box.max = Vector3Max(box.max, Vector3 { tileMesh.positions[j], tileMesh.positions[j + 1], tileMesh.positions[j + 2] });
+                }
+            }
+            for (const BoundingBox& box : meshBounds)
+            {
+                bounds.min = Vector3Min(bounds.min, box.min);
+                bounds.max = Vector3Max(bounds.max, box.max);
+            }
 
-                materialNode["mesh"] = meshes.size();
-                meshes.push_back(mesh);
+            // Every primitive of a mesh has to share the quantization grid, because they share the node's transform.
+            QuantizationGrid nodeGrid = QuantizationGridFromBounds(bounds);
+            if (options.quantize && !options.separateGeometry && !tileMeshes.empty())
+            {
+                setQuantizationTransform(node, nodeGrid);
+            }
 
-                mapNodeChildren.push_back(nodes.size());
-                nodes.push_back(materialNode);
+            std::vector<json> prims;
+            std::vector<int> children;
+            for (size_t m = 0; m < tileMeshes.size(); ++m)
+            {
+                const TileMesh& tileMesh = tileMeshes[m];
+                QuantizationGrid grid = options.separateGeometry ? QuantizationGridFromBounds(meshBounds[m]) : nodeGrid;
+
+                json primitive;
+                if (options.quantize)
+                {
+                    primitive = pushQuantizedPrimitive(tileMesh, grid);
+                }
+                else
+                {
+                    Vector3 min, max;
+                    primitive = pushPrimitive(tileMesh.positions.data(), tileMesh.texCoords.data(), tileMesh.normals.data(), tileMesh.positions.size() / 3, 
+                        tileMesh.indices.data(), tileMesh.indices.size(), min, max);
+                }
+                if (!tileMesh.colors.empty()) primitive["attributes"]["COLOR_0"] = pushVertexColors(tileMesh);
+                primitive["material"] = options.atlasTextures ? atlasMaterials[tileMesh.texture] : getMaterial(tileMesh.texture);
+
+                if (options.separateGeometry)
+                {
+                    // When separate geometry is enabled, each material gets its own node containing its portion of the map geometry
+                    json materialNode = {
+                        {"name", options.atlasTextures ? atlasNodeNames[tileMesh.texture] : textureNodeName(tileMesh.texture)},
+                        {"mesh", meshes.size()}
+                    };
+                    if (options.quantize) setQuantizationTransform(materialNode, grid);
+                    meshes.push_back({
+                        {"primitives", {primitive}}
+                    });
+
+                    children.push_back(nodes.size());
+                    nodes.push_back(materialNode);
+                }
+                else
+                {
+                    prims.push_back(primitive);
+                }
             }
-        }
 
-        samplers.push_back({
-            {"magFilter", FILTER_NEAREST},
-            {"minFilter", FILTER_NEAREST_MIP_NEAREST},
-            {"wrapS", WRAP_REPEAT},
-            {"wrapT", WRAP_REPEAT},
-        });
+            if (!prims.empty())
+            {
+                node["mesh"] = meshes.size();
+                meshes.push_back({
+                    {"primitives", prims}
+                });
+            }
+            if (!children.empty())
+            {
+                node["children"] = children;
+            }
 
-        // Everything is stored in one buffer, to make it compatible with .GLB
-        size_t bufferSize = bufferOffset;
-        json buffer = {{"byteLength", bufferSize}};
+            return bounds;
+        };
+
+        if (!options.instanceTiles)
+        {
+            // Without chunking, the whole map is treated as one big chunk.
+            int chunkSize = (options.chunkSize > 0) ? options.chunkSize : Max(_tileGrid.GetWidth(), Max(_tileGrid.GetHeight(), _tileGrid.GetLength()));
+            struct Chunk 
+            { 
+                int x, y, z; // Chunk coordinates
+                int i, j, k, w, h, l; // Extents in grid cels
+            };
+            std::vector<Chunk> chunks;
+            for (int y = 0; y * chunkSize < (int)_tileGrid.GetHeight(); ++y)
+            {
+                for (int z = 0; z * chunkSize < (int)_tileGrid.GetLength(); ++z)
+                {
+                    for (int x = 0; x * chunkSize < (int)_tileGrid.GetWidth(); ++x)
+                    {
+                        Chunk chunk = { x, y, z, x * chunkSize, y * chunkSize, z * chunkSize, 0, 0, 0 };
+                        chunk.w = Min(chunkSize, (int)_tileGrid.GetWidth() - chunk.i);
+                        chunk.h = Min(chunkSize, (int)_tileGrid.GetHeight() - chunk.j);
+                        chunk.l = Min(chunkSize, (int)_tileGrid.GetLength() - chunk.k);
+                        chunks.push_back(chunk);
+                    }
+                }
+            }
+
+            // Merged faces repeat their textures, which an atlas would have to split up again into even more triangles than before.
+            // They also stretch across corners that ambient occlusion needs vertices at.
+            bool mergeFaces = options.mergeFaces && !options.atlasTextures && !options.ambientOcclusion;
+
+            // Generate the geometry of each chunk in parallel. The grid is only read from during this.
+            chunkMeshes.resize(chunks.size());
+            std::atomic<size_t> generatedTriangles = 0, mergedTriangles = 0;
+            ParallelFor(chunks.size(), [&](size_t c)
+            {
+                const Chunk& chunk = chunks[c];
+                chunkMeshes[c] = _tileGrid.GenerateMeshes(chunk.i, chunk.j, chunk.k, chunk.w, chunk.h, chunk.l, options.cullFaces);
+                for (TileMesh& tileMesh : chunkMeshes[c])
+                {
+                    generatedTriangles += tileMesh.indices.size() / 3;
+                    if (mergeFaces) mergedTriangles += MergeCoplanarFaces(tileMesh, _tileGrid.GetSpacing());
+                }
+            });
+
+            renderTriangleCount = generatedTriangles;
+
+            if (mergeFaces)
+            {
+                std::cout << "Merging coplanar faces removed " << mergedTriangles << " of " << generatedTriangles << " triangles." << std::endl;
+            }
+
+            if (options.atlasTextures)
+            {
+                // Load the images of every texture that the geometry uses
+                std::map<TexID, size_t> imageIndices;
+                std::vector<Image> tileImages;
+                size_t meshCount = 0;
+                for (const std::vector<TileMesh>& meshes : chunkMeshes)
+                {
+                    for (const TileMesh& tileMesh : meshes)
+                    {
+                        ++meshCount;
+                        if (imageIndices.find(tileMesh.texture) != imageIndices.end()) continue;
+
+                        fs::path imagePath = PathFromTexID(tileMesh.texture);
+                        Image image = LoadImage(imagePath.string().c_str());
+                        if (!IsImageValid(image))
+                        {
+                            for (Image& loaded : tileImages) UnloadImage(loaded);
+                            throw std::runtime_error("Could not load texture " + imagePath.generic_string() + " for the atlas.");
+                        }
+                        ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+                        imageIndices[tileMesh.texture] = tileImages.size();
+                        tileImages.push_back(image);
+                    }
+                }
 
-        bufferData = SAFE_MALLOC(uint8_t, bufferSize);
+                std::vector<AtlasRegion> regions;
+                std::vector<Image> pages = PackTextureAtlas(tileImages, ATLAS_GUTTER, ATLAS_MAX_SIZE, regions);
+                for (Image& image : tileImages) UnloadImage(image);
 
-        // Fill the buffer with the mesh data, now that we know all of the counts and offsets.
-        for (int i = 0; i < mapModel.meshCount; ++i)
+                // The atlas images are saved next to the exported file.
+                bool pagesSaved = true;
+                for (size_t p = 0; p < pages.size(); ++p)
+                {
+                    std::string pageName = filePath.stem().string() + "_atlas" + std::to_string(p) + ".png";
+                    fs::path pagePath = filePath.parent_path() / pageName;
+                    if (!ExportImage(pages[p], pagePath.string().c_str())) pagesSaved = false;
+                    UnloadImage(pages[p]);
+
+                    atlasMaterials.push_back(pushMaterial(pagePath));
+                    atlasNodeNames.push_back(NodeNameFromPath(pageName));
+                }
+                if (!pagesSaved) throw std::runtime_error("Could not save the texture atlas images.");
+
+                // Each chunk gets one mesh per atlas page, unless it has too many vertices.
+                std::atomic<size_t> primitiveCount = 0;
+                ParallelFor(chunkMeshes.size(), [&](size_t c)
+                {
+                    std::vector<std::vector<TileMesh>> pageMeshes(pages.size());
+                    for (const TileMesh& tileMesh : chunkMeshes[c])
+                    {
+                        const AtlasRegion& region = regions[imageIndices.at(tileMesh.texture)];
+                        AppendInAtlasSpace(tileMesh, region.uvRect, (TexID)region.page, pageMeshes[region.page]);
+                    }
+                    chunkMeshes[c].clear();
+                    for (std::vector<TileMesh>& meshes : pageMeshes)
+                    {
+                        primitiveCount += meshes.size();
+                        std::move(meshes.begin(), meshes.end(), std::back_inserter(chunkMeshes[c]));
+                    }
+                });
+
+                std::cout << "Baked " << tileImages.size() << " textures into " << pages.size() << " atlas pages. "
+                    << "Materials went from " << tileImages.size() << " to " << pages.size() << ", "
+                    << "and draw calls from " << meshCount << " to " << primitiveCount << "." << std::endl;
+            }
+
+            if (options.optimizeMeshes)
+            {
+                // Meshes are optimized separately, so this is still parallel when the map isn't split into chunks.
+                std::vector<TileMesh*> allMeshes;
+                for (std::vector<TileMesh>& meshes : chunkMeshes)
+                {
+                    for (TileMesh& tileMesh : meshes) allMeshes.push_back(&tileMesh);
+                }
+                std::atomic<size_t> triangleCount = 0, verticesBefore = 0, verticesAfter = 0, missesBefore = 0, missesAfter = 0;
+                ParallelFor(allMeshes.size(), [&](size_t m)
+                {
+                    TileMesh& tileMesh = *allMeshes[m];
+                    triangleCount += tileMesh.indices.size() / 3;
+                    verticesBefore += tileMesh.positions.size() / 3;
+                    missesBefore += CountCacheMisses(tileMesh);
+                    WeldVertices(tileMesh);
+                    OptimizeVertexCache(tileMesh);
+                    verticesAfter += tileMesh.positions.size() / 3;
+                    missesAfter += CountCacheMisses(tileMesh);
+                });
+                if (triangleCount > 0)
+                {
+                    std::cout << "Welding reduced " << verticesBefore << " vertices to " << verticesAfter << ". "
+                        << "ACMR went from " << (float)missesBefore / triangleCount << " to " << (float)missesAfter / triangleCount << "." << std::endl;
+                }
+            }
+
+            if (options.ambientOcclusion)
+            {
+                // Welding already happened, so vertices shared by neighboring tiles only get sampled once.
+                const std::vector<bool> fullCubeShapes = _tileGrid.GetFullCubeShapes();
+                std::atomic<size_t> vertexCount = 0;
+                auto bakeStart = std::chrono::steady_clock::now();
+                ParallelFor(chunkMeshes.size(), [&](size_t c)
+                {
+                    for (TileMesh& tileMesh : chunkMeshes[c])
+                    {
+                        _tileGrid.BakeAmbientOcclusion(tileMesh, fullCubeShapes);
+                        vertexCount += tileMesh.positions.size() / 3;
+                    }
+                });
+                double bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bakeStart).count();
+                std::cout << "Baked ambient occlusion for " << vertexCount << " vertices in " << bakeMs << " ms";
+                if (vertexCount > 0) std::cout << " (" << bakeMs * 1000000.0 / vertexCount << " ms per million vertices)";
+                std::cout << "." << std::endl;
+            }
+
+            if (options.chunkSize <= 0)
+            {
+                if (!chunkMeshes.empty()) addTileMeshes(mapNode, chunkMeshes[0]);
+            }
+            else
+            {
+                // Each chunk with geometry gets its own node, with its coordinates and bounds in the extras.
+                for (size_t c = 0; c < chunks.size(); ++c)
+                {
+                    if (chunkMeshes[c].empty()) continue;
+
+                    const Chunk& chunk = chunks[c];
+                    json chunkNode = {
+                        {"name", "chunk_" + std::to_string(chunk.x) + "_" + std::to_string(chunk.y) + "_" + std::to_string(chunk.z)}
+                    };
+                    BoundingBox bounds = addTileMeshes(chunkNode, chunkMeshes[c]);
+                    chunkNode["extras"] = {
+                        {"chunk", { chunk.x, chunk.y, chunk.z }},
+                        {"chunkSize", chunkSize},
+                        {"min", { bounds.min.x, bounds.min.y, bounds.min.z }},
+                        {"max", { bounds.max.x, bounds.max.y, bounds.max.z }}
+                    };
+
+                    mapNodeChildren.push_back(nodes.size());
+                    nodes.push_back(chunkNode);
+                }
+            }
+        }
+        else
         {
-            // Position
+            // Names for each mesh of each shape, so that the instance nodes can be told apart.
+            std::map<const Mesh*, std::string> shapeMeshNames;
+            for (ModelID id = 0; id < GetNumModels(); ++id)
             {
-                const json& bufferView = bufferViews[i * 4 + 0];
-                size_t byteOffset = (size_t) bufferView["byteOffset"];
-                size_t byteLength = (size_t) bufferView["byteLength"];
-                memcpy(&bufferData[byteOffset], mapModel.meshes[i].vertices, byteLength);
+                const Model shape = ModelFromID(id);
+                std::string shapeName = NodeNameFromPath(fs::relative(fs::current_path() / PathFromModelID(id), fs::current_path() / App::Get()->GetShapesDir()));
+                for (int m = 0; m < shape.meshCount; ++m)
+                {
+                    shapeMeshNames[&shape.meshes[m]] = (shape.meshCount > 1) ? (shapeName + "_" + std::to_string(m)) : shapeName;
+                }
             }
-            // Tex coord
+
+            // Shape meshes are only written once, even if they are used with several textures.
+            std::map<const Mesh*, json> shapePrims;
+
+            // Each combination of texture and shape mesh gets one mesh, which is placed at every tile that uses it through EXT_mesh_gpu_instancing.
+            for (const auto& [pair, matrices] : _tileGrid.GetDrawBatches())
             {
-                const json& bufferView = bufferViews[i * 4 + 1];
-                size_t byteOffset = (size_t) bufferView["byteOffset"];
-                size_t byteLength = (size_t) bufferView["byteLength"];
-                memcpy(&bufferData[byteOffset], mapModel.meshes[i].texcoords, byteLength);
+                const auto& [texID, shapeMesh] = pair;
+
+                auto primIter = shapePrims.find(shapeMesh);
+                if (primIter == shapePrims.end())
+                {
+                    Vector3 min, max;
+                    json shapePrim = pushPrimitive(shapeMesh->vertices, shapeMesh->texcoords, shapeMesh->normals, shapeMesh->vertexCount, 
+                        shapeMesh->indices, shapeMesh->triangleCount * 3, min, max);
+                    primIter = shapePrims.emplace(shapeMesh, shapePrim).first;
+                }
+                json primitive = primIter->second;
+                primitive["material"] = getMaterial(texID);
+                renderTriangleCount += shapeMesh->triangleCount * matrices.size();
+
+                std::vector<float>& translations = generatedData.emplace_back();
+                std::vector<float>& rotations = generatedData.emplace_back();
+                translations.reserve(matrices.size() * 3);
+                rotations.reserve(matrices.size() * 4);
+                for (const Matrix& matrix : matrices)
+                {
+                    Quaternion rotation = QuaternionFromMatrix(matrix);
+                    translations.insert(translations.end(), { matrix.m12, matrix.m13, matrix.m14 });
+                    rotations.insert(rotations.end(), { rotation.x, rotation.y, rotation.z, rotation.w });
+                }
+
+                size_t translationIdx = pushVertexAttrib(translations.data(), sizeof(float) * 3, matrices.size(), "VEC3", COMP_TYPE_FLOAT, TARGET_NONE);
+                size_t rotationIdx = pushVertexAttrib(rotations.data(), sizeof(float) * 4, matrices.size(), "VEC4", COMP_TYPE_FLOAT, TARGET_NONE);
+
+                json instanceNode = {
+                    {"name", shapeMeshNames[shapeMesh] + "_" + textureNodeName(texID)},
+                    {"mesh", meshes.size()},
+                    {"extensions", {
+                        {"EXT_mesh_gpu_instancing", {
+                            {"attributes", {
+                                {"TRANSLATION", translationIdx},
+                                {"ROTATION", rotationIdx}
+                            }}
+                        }}
+                    }}
+                };
+                meshes.push_back({
+                    {"primitives", {primitive}}
+                });
+
+                mapNodeChildren.push_back(nodes.size());
+                nodes.push_back(instanceNode);
             }
-            // Normals
+
+            // The tiles would all be piled up at the origin without the extension, so it is required.
+            extensionsUsed.push_back("EXT_mesh_gpu_instancing");
+        }
+
+        // The positions are meaningless to a loader that doesn't apply the extension, so it is required.
+        if (options.quantize) extensionsUsed.push_back("KHR_mesh_quantization");
+
+        if (!mapNodeChildren.empty())
+        {
+            mapNode["children"] = mapNodeChildren;
+        }
+
+        // The collision is a separate root node, so that it isn't affected by any transform given to the map node for quantization.
+        json collisionNode = nullptr;
+        if (options.collision)
+        {
+            // The grid is split into blocks that are processed in parallel. Boxes don't reach across the blocks' borders.
+            struct Block 
+            { 
+                int i, j, k, w, h, l; 
+            };
+            std::vector<Block> blocks;
+            for (int y = 0; y < (int)_tileGrid.GetHeight(); y += COLLISION_BLOCK_SIZE)
             {
-                const json& bufferView = bufferViews[i * 4 + 2];
-                size_t byteOffset = (size_t) bufferView["byteOffset"];
-                size_t byteLength = (size_t) bufferView["byteLength"];
-                memcpy(&bufferData[byteOffset], mapModel.meshes[i].normals, byteLength);
+                for (int z = 0; z < (int)_tileGrid.GetLength(); z += COLLISION_BLOCK_SIZE)
+                {
+                    for (int x = 0; x < (int)_tileGrid.GetWidth(); x += COLLISION_BLOCK_SIZE)
+                    {
+                        blocks.push_back(Block { 
+                            x, y, z, 
+                            Min(COLLISION_BLOCK_SIZE, (int)_tileGrid.GetWidth() - x), 
+                            Min(COLLISION_BLOCK_SIZE, (int)_tileGrid.GetHeight() - y), 
+                            Min(COLLISION_BLOCK_SIZE, (int)_tileGrid.GetLength() - z) 
+                        });
+                    }
+                }
             }
-            // Indices
+
+            const std::vector<bool> fullCubeShapes = _tileGrid.GetFullCubeShapes();
+            std::vector<TileCollision> blockCollisions(blocks.size());
+            ParallelFor(blocks.size(), [&](size_t b)
+            {
+                const Block& block = blocks[b];
+                blockCollisions[b] = _tileGrid.GenerateCollision(block.i, block.j, block.k, block.w, block.h, block.l, fullCubeShapes);
+            });
+
+            // The boxes are listed in the extras for engines that have box colliders, and included in the mesh for those that don't.
+            std::vector<float>& positions = generatedData.emplace_back();
+            json boxes = json::array();
+            size_t shapeTriangleCount = 0;
+            for (const TileCollision& collision : blockCollisions)
+            {
+                for (const BoundingBox& box : collision.boxes)
+                {
+                    boxes.push_back({ box.min.x, box.min.y, box.min.z, box.max.x, box.max.y, box.max.z });
+                    AppendBoxTriangles(positions, box);
+                }
+                positions.insert(positions.end(), collision.triangles.begin(), collision.triangles.end());
+                shapeTriangleCount += collision.triangles.size() / 9;
+            }
+
+            collisionNode = {
+                {"name", "collision"},
+                {"extras", {
+                    {"boxes", boxes}
+                }}
+            };
+            if (!positions.empty())
             {
-                const json& bufferView = bufferViews[i * 4 + 3];
-                size_t byteOffset = (size_t) bufferView["byteOffset"];
-                size_t byteLength = (size_t) bufferView["byteLength"];
-                memcpy(&bufferData[byteOffset], mapModel.meshes[i].indices, byteLength);
+                // The mesh only has positions, and no indices so that it isn't limited to 16 bit indices.
+                size_t vertexCount = positions.size() / 3;
+                Vector3 min = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+                Vector3 max = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+                for (size_t v = 0; v < vertexCount; ++v)
+                {
+                    min = Vector3Min(min, Vector3 { positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2] });
+                    max = Vector3Max(max, Vector3 { positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2] });
+                }
+                size_t posBufferIdx = pushVertexAttrib(positions.data(), sizeof(float) * 3, vertexCount, "VEC3", COMP_TYPE_FLOAT);
+                accessors[posBufferIdx]["min"] = {min.x, min.y, min.z};
+                accessors[posBufferIdx]["max"] = {max.x, max.y, max.z};
+
+                collisionNode["mesh"] = meshes.size();
+                meshes.push_back({
+                    {"primitives", {{
+                        {"mode", PRIMITIVE_MODE_TRIANGLES},
+                        {"attributes", {
+                            {"POSITION", posBufferIdx}
+                        }}
+                    }}}
+                });
             }
+
+            size_t collisionTriangleCount = boxes.size() * 12 + shapeTriangleCount;
+            std::cout << "Collision has " << boxes.size() << " boxes and " << shapeTriangleCount << " triangles from other shapes. "
+                << "That is " << collisionTriangleCount << " triangles in total, compared to " << renderTriangleCount << " in the tile geometry." << std::endl;
         }
 
+        samplers.push_back({
+            {"magFilter", FILTER_NEAREST},
+            {"minFilter", FILTER_NEAREST_MIP_NEAREST},
+            {"wrapS", WRAP_REPEAT},
+            {"wrapT", WRAP_REPEAT},
+        });
+
+        // Everything is stored in one buffer, to make it compatible with .GLB
+        size_t bufferSize = bufferOffset;
+        json buffer = {{"byteLength", bufferSize}};
+
+        // For plain .gltf files, the buffer is encoded into a base64 data string, which is streamed into the file in place of this prefix.
+        // For .glb, the buffer will be written to the end of the binary file later.
+        static const std::string BASE64_URI_PREFIX = "data:application/octet-stream;base64,";
         if (!isGLB)
         {
-            // For plain .gltf files, simply encode the buffer into a base64 data string.
-            // For .glb, the buffer will be written to the end of the binary file later.
-            buffer["uri"] = std::string("data:application/octet-stream;base64,") + base64::encode(bufferData, bufferSize);
+            buffer["uri"] = BASE64_URI_PREFIX;
         }
 
         buffers.push_back(buffer);
 
-        json mapNode = {{"name", "map"}};
-
         // Indices for each root node, because the scene object requires a list of them.
         std::vector<int> rootNodes;
 
-        if (!separateGeometry)
-        {
-            // Assign all whole map geometry to the map node
-            mapNode["mesh"] = meshes.size();
-            meshes.push_back({
-                {"primitives", mapPrims}
-            });
-        }
-        else
-        {
-            mapNode["children"] = mapNodeChildren;
-        }
-        
         rootNodes.push_back(nodes.size());
         nodes.push_back(mapNode);
 
+        if (!collisionNode.is_null())
+        {
+            rootNodes.push_back(nodes.size());
+            nodes.push_back(collisionNode);
+        }
+
         // Add entities as nodes
         for (const Ent &ent : _entGrid.GetEntList())
         {
@@ -323,6 +1022,12 @@ bool MapMan::ExportGLTFScene(fs::path filePath, bool separateGeometry)
             {"samplers", samplers}
         };
 
+        if (!extensionsUsed.empty())
+        {
+            jsonData["extensionsUsed"] = extensionsUsed;
+            jsonData["extensionsRequired"] = extensionsUsed;
+        }
+
         // Write JSON to file
         std::ofstream file(filePath, isGLB ? std::ios::binary : std::ios::out);
         std::string jsonString = to_string(jsonData);
@@ -344,7 +1049,18 @@ bool MapMan::ExportGLTFScene(fs::path filePath, bool separateGeometry)
         static const uint32_t GLB_JSON = 0x4E4F534AU;
         static const uint32_t GLB_BIN = 0x004E4942U;
         static const uint8_t SPACE = 0x20U;
-        static const uint8_t ZERO = 0x00U;
+
+        // Copies each piece of the buffer from the mesh data directly into the file.
+        BufferStreamWriter bufferWriter(file, !isGLB);
+        auto writeBuffer = [&]()
+        {
+            for (const BufferSegment& segment : bufferSegments)
+            {
+                bufferWriter.WriteSegment(segment);
+            }
+            bufferWriter.WriteZeroes(bufferSize - bufferWriter.GetBytesWritten());
+            bufferWriter.Finish();
+        };
 
         if (isGLB)
         {
@@ -358,12 +1074,9 @@ bool MapMan::ExportGLTFScene(fs::path filePath, bool separateGeometry)
             uint32_t jsonDataLength = jsonLength + (uint32_t)jsonPadding;
             WRITE_BIN(jsonDataLength);
             WRITE_BIN(GLB_JSON);
-        }
 
-        file.write(jsonString.c_str(), jsonLength);
-        
-        if (isGLB)
-        {
+            file.write(jsonString.c_str(), jsonLength);
+
             // Pad with spaces to align chunk with 4 byte boundary
             for (int p = 0; p < jsonPadding; ++p) 
                 WRITE_BIN(SPACE);
@@ -373,15 +1086,27 @@ bool MapMan::ExportGLTFScene(fs::path filePath, bool separateGeometry)
             WRITE_BIN(binDataLength);
             WRITE_BIN(GLB_BIN);
 
-            // Write data
-            file.write(reinterpret_cast<char*>(bufferData), bufferSize);
-            
-            // Pad with zeroes to align with 4 byte boundary
-            for (int p = 0; p < binPadding; ++p)
-                WRITE_BIN(ZERO);
+            // Write data, padded with zeroes to align with 4 byte boundary
+            writeBuffer();
+            bufferWriter.WriteZeroes(binPadding);
+        }
+        else
+        {
+            // The only string in the JSON that starts with the prefix is the buffer's URI, since nothing before "buffers" contains user text.
+            size_t uriEnd = jsonString.find(BASE64_URI_PREFIX) + BASE64_URI_PREFIX.size();
+            file.write(jsonString.c_str(), uriEnd);
+            writeBuffer();
+            file.write(jsonString.c_str() + uriEnd, jsonLength - uriEnd);
         }
         
         if (file.fail()) error = true;
+
+        if (options.navGrid && !error)
+        {
+            fs::path navPath = filePath;
+            navPath.replace_extension(".nav");
+            if (!ExportNavGrid(navPath, options.navHeightfield)) throw std::runtime_error("Could not save the navigation grid to " + navPath.generic_string() + ".");
+        }
     }
     catch (const std::exception &e)
     {
@@ -393,6 +1118,145 @@ bool MapMan::ExportGLTFScene(fs::path filePath, bool separateGeometry)
         error = true;
     }
 
-    if (bufferData != nullptr) free(bufferData);
     return !error;
-}
\ No newline at end of file
+}
+
+// Appends `value` to `bytes` in little endian order, regardless of the platform's byte order.
+template<typename T>
+static void AppendBytes(std::vector<uint8_t>& bytes, T value)
+{
+    static const uint16_t testInt = 1;
+    static const bool bigEndian = !*(unsigned char *)&testInt;
+
+    const uint8_t* valuesBytes = reinterpret_cast<const uint8_t*>(&value);
+    
+    for (size_t b = 0; b < sizeof(T); ++b)
+    {
+        bytes.push_back(valuesBytes[bigEndian ? sizeof(T) - 1 - b : b]);
+    }
+}
+
+// The navigation grid file is meant to be memory mapped, so everything is little endian and 4 byte aligned.
+// Header (13 x uint32): magic "TE3N", version, width, height, length, spacing (float32), flags (bit 0: has heightfield), 
+// byte offsets of the shape table, occupancy, shapes, orientations, and heightfield (0 if absent), and the total file size.
+// Shape table: uint32 count, then for each shape a uint16 byte length followed by its path.
+// Occupancy: one bit per cel in flat index order (x + z * width + y * width * length), least significant bit first.
+// Shapes: int16 per cel, indexing the shape table, or -1 if empty or the shape isn't in the table.
+// Orientations: uint8 per cel, with the yaw in bits 0-1 and the pitch in bits 2-3, in quarter turns.
+// Heightfield: int16 per column (x + z * width), the lowest empty layer above the highest full cube, or -1 if there is none.
+bool MapMan::ExportNavGrid(fs::path filePath, bool includeHeightfield)
+{
+    try
+    {
+        const size_t width = _tileGrid.GetWidth(), height = _tileGrid.GetHeight(), length = _tileGrid.GetLength();
+        const size_t cellCount = width * height * length;
+        if (GetNumModels() > INT16_MAX) throw std::runtime_error("There are too many shapes to fit in the navigation grid.");
+
+        // The sections are built in memory and written one after the other, each starting on a 4 byte boundary.
+        std::vector<uint8_t> shapeTable;
+        const std::vector<fs::path> modelPaths = GetModelPathList();
+        AppendBytes<uint32_t>(shapeTable, modelPaths.size());
+        for (const fs::path& path : modelPaths)
+        {
+            std::string pathString = path.generic_string();
+            if (pathString.size() > UINT16_MAX) throw std::runtime_error("Shape path " + pathString + " is too long.");
+            AppendBytes<uint16_t>(shapeTable, pathString.size());
+            shapeTable.insert(shapeTable.end(), pathString.begin(), pathString.end());
+        }
+
+        // One bit per cel, in the same order as the grid's flat indices. Bit n is in byte n / 8.
+        std::vector<uint8_t> occupancy((cellCount + 7) / 8, 0);
+        // Index into the shape table, or -1 for empty cels and shapes missing from the table.
+        std::vector<int16_t> shapes(cellCount, -1);
+        // Yaw in the low two bits and pitch in the next two.
+        std::vector<uint8_t> orientations(cellCount, 0);
+        for (size_t c = 0; c < cellCount; ++c)
+        {
+            Tile tile = _tileGrid.GetTile((int)c);
+            if (!tile) continue;
+            occupancy[c / 8] |= (uint8_t)(1 << (c % 8));
+            if (tile.shape >= 0 && (size_t)tile.shape < modelPaths.size()) shapes[c] = (int16_t)tile.shape;
+            orientations[c] = (uint8_t)((tile.yaw % 4) | ((tile.pitch % 4) << 2));
+        }
+
+        // For each column, ordered by X and then Z, the layer above the highest full cube that has open space on top of it.
+        // The top of a full cube is flat no matter how it is rotated, so that is where something can stand. -1 if there is none.
+        std::vector<int16_t> heightfield;
+        if (includeHeightfield)
+        {
+            if (height > INT16_MAX) throw std::runtime_error("The map is too tall for the navigation heightfield.");
+            heightfield.assign(width * length, -1);
+            const std::vector<bool> fullCubeShapes = _tileGrid.GetFullCubeShapes();
+            for (size_t k = 0; k < length; ++k)
+            {
+                for (size_t i = 0; i < width; ++i)
+                {
+                    for (int j = (int)height - 1; j >= 0; --j)
+                    {
+                        Tile tile = _tileGrid.GetTile(i, j, k);
+                        if (!TileGrid::IsFullCube(tile, fullCubeShapes)) continue;
+                        if (j + 1 < (int)height && _tileGrid.GetTile(i, j + 1, k)) continue;
+                        heightfield[i + k * width] = (int16_t)(j + 1);
+                        break;
+                    }
+                }
+            }
+        }
+
+        static const uint32_t NAV_MAGIC = 0x4E334554U; // "TE3N"
+        static const uint32_t NAV_VERSION = 0x01U;
+        static const uint32_t NAV_FLAG_HEIGHTFIELD = 0x01U;
+        // Magic, version, width, height, length, spacing, flags, five section offsets, and the file size.
+        static const uint32_t NAV_HEADER_SIZE = 13U * 4U;
+
+        auto paddedSize = [](size_t size)->size_t { return (size + 3) & ~(size_t)3; };
+        const size_t shapeTableOffset = NAV_HEADER_SIZE;
+        const size_t occupancyOffset = shapeTableOffset + paddedSize(shapeTable.size());
+        const size_t shapesOffset = occupancyOffset + paddedSize(occupancy.size());
+        const size_t orientationsOffset = shapesOffset + paddedSize(shapes.size() * sizeof(int16_t));
+        const size_t heightfieldOffset = orientationsOffset + paddedSize(orientations.size());
+        const size_t fileSize = heightfieldOffset + paddedSize(heightfield.size() * sizeof(int16_t));
+        if (fileSize > UINT32_MAX) throw std::runtime_error("The map is too big for a navigation grid file.");
+
+        // Multi-byte values are appended one byte at a time, so the file is little endian on any platform.
+        std::vector<uint8_t> bytes;
+        bytes.reserve(fileSize);
+        for (uint32_t value : { NAV_MAGIC, NAV_VERSION, (uint32_t)width, (uint32_t)height, (uint32_t)length })
+        {
+            AppendBytes<uint32_t>(bytes, value);
+        }
+        AppendBytes<float>(bytes, _tileGrid.GetSpacing());
+        for (uint32_t value : { 
+            includeHeightfield ? NAV_FLAG_HEIGHTFIELD : 0U,
+            (uint32_t)shapeTableOffset, (uint32_t)occupancyOffset, (uint32_t)shapesOffset, (uint32_t)orientationsOffset, 
+            includeHeightfield ? (uint32_t)heightfieldOffset : 0U, 
+            (uint32_t)fileSize })
+        {
+            AppendBytes<uint32_t>(bytes, value);
+        }
+
+        // Each section starts where the previous one ends, so padding the end of the data keeps the next one aligned.
+        auto padSection = [&]() { bytes.resize(paddedSize(bytes.size()), 0); };
+        bytes.insert(bytes.end(), shapeTable.begin(), shapeTable.end());
+        padSection();
+        bytes.insert(bytes.end(), occupancy.begin(), occupancy.end());
+        padSection();
+        for (int16_t shape : shapes) AppendBytes<int16_t>(bytes, shape);
+        padSection();
+        bytes.insert(bytes.end(), orientations.begin(), orientations.end());
+        padSection();
+        for (int16_t columnHeight : heightfield) AppendBytes<int16_t>(bytes, columnHeight);
+        padSection();
+
+        std::ofstream file(filePath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if (file.fail()) return false;
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << e.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
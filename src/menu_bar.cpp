@@ -168,6 +168,7 @@ void MenuBar::Draw()
             if (ImGui::MenuItem("SAVE AS")) OpenSaveMapDialog();
             if (ImGui::MenuItem("EXPORT")) _activeDialog.reset(new ExportDialog(_settings));
             if (ImGui::MenuItem("EXPAND GRID")) _activeDialog.reset(new ExpandMapDialog());
+            if (ImGui::MenuItem("REPLACE TILES")) _activeDialog.reset(new ReplaceTilesDialog());
             if (ImGui::MenuItem("SHRINK GRID")) 
             {
                 _activeDialog.reset(new ConfirmationDialog(
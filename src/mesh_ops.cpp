@@ -0,0 +1,651 @@
+/**
+ * Copyright (c) 2022-present Alexander Lunsford
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#include "mesh_ops.hpp"
+
+#include "raylib.h"
+#include "raymath.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <array>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+#define MERGE_EPSILON 0.0001f
+// Number of steps per unit that positions and texture coordinates are rounded to when comparing faces.
+#define MERGE_PRECISION 1024.0f
+
+static int64_t Quantize(float value)
+{
+    return llroundf(value * MERGE_PRECISION);
+}
+
+// Identifies the faces that can be merged with each other.
+struct FaceKey
+{
+    int axis; // Index of the axis that the face is perpendicular to
+    bool positive; // True if the face points in the positive direction of the axis
+    int64_t plane; // Position of the face along the axis
+    std::array<int64_t, 4> uvScale; // Change in texture coordinates per unit along each of the face's two axes
+    std::array<int64_t, 2> uvOffset; // Fractional part of the texture coordinates at the origin
+
+    inline bool operator<(const FaceKey& other) const
+    {
+        if (axis != other.axis) return axis < other.axis;
+        if (positive != other.positive) return positive < other.positive;
+        if (plane != other.plane) return plane < other.plane;
+        if (uvScale != other.uvScale) return uvScale < other.uvScale;
+        return uvOffset < other.uvOffset;
+    }
+};
+
+// Triangles found on one side of a grid cel
+struct CelFace
+{
+    int triangles[2];
+    uint8_t cornerMasks[2]; // Bits for each corner of the cel that the triangle touches
+    int count;
+    Vector2 uvOffset; // Texture coordinates at the origin of the plane, for the first triangle
+};
+
+// All of the faces that can be merged with each other, by grid cel coordinates along the face's axes
+struct FaceGroup
+{
+    float plane;
+    Vector2 uvScaleS, uvScaleT;
+    std::map<std::pair<int, int>, CelFace> cels;
+};
+
+size_t MergeCoplanarFaces(TileMesh& mesh, float spacing)
+{
+    std::map<FaceKey, FaceGroup> groups;
+
+    const size_t triangleCount = mesh.indices.size() / 3;
+    auto position = [&](int v){ return Vector3 { mesh.positions[v * 3], mesh.positions[v * 3 + 1], mesh.positions[v * 3 + 2] }; };
+    auto normal = [&](int v){ return Vector3 { mesh.normals[v * 3], mesh.normals[v * 3 + 1], mesh.normals[v * 3 + 2] }; };
+    auto texCoord = [&](int v){ return Vector2 { mesh.texCoords[v * 2], mesh.texCoords[v * 2 + 1] }; };
+
+    // Find the triangles that cover exactly half of one side of a grid cel
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        int v[3] = { mesh.indices[t * 3], mesh.indices[t * 3 + 1], mesh.indices[t * 3 + 2] };
+        Vector3 p[3] = { position(v[0]), position(v[1]), position(v[2]) };
+
+        Vector3 faceNormal = Vector3Normalize(Vector3CrossProduct(p[1] - p[0], p[2] - p[0]));
+        float faceNormalComps[3] = { faceNormal.x, faceNormal.y, faceNormal.z };
+        int axis = -1;
+        for (int a = 0; a < 3; ++a)
+        {
+            if (fabsf(fabsf(faceNormalComps[a]) - 1.0f) < MERGE_EPSILON) axis = a;
+        }
+        if (axis < 0) continue;
+
+        // The vertex normals must match the face's, or else merging would change the shading.
+        bool flat = true;
+        for (int c = 0; c < 3; ++c)
+        {
+            if (Vector3DotProduct(normal(v[c]), faceNormal) < 1.0f - MERGE_EPSILON) flat = false;
+        }
+        if (!flat) continue;
+
+        // Coordinates of the vertices along the two axes of the plane
+        int axisS = (axis + 1) % 3, axisT = (axis + 2) % 3;
+        float s[3], tc[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            float comps[3] = { p[c].x, p[c].y, p[c].z };
+            s[c] = comps[axisS];
+            tc[c] = comps[axisT];
+        }
+
+        int celS = (int)floorf(Minf(s[0], Minf(s[1], s[2])) / spacing + MERGE_EPSILON);
+        int celT = (int)floorf(Minf(tc[0], Minf(tc[1], tc[2])) / spacing + MERGE_EPSILON);
+
+        // Each vertex has to be on a different corner of the cel
+        uint8_t cornerMask = 0;
+        for (int c = 0; c < 3; ++c)
+        {
+            float cornerS = (s[c] / spacing) - celS;
+            float cornerT = (tc[c] / spacing) - celT;
+            int bitS = (fabsf(cornerS) < MERGE_EPSILON) ? 0 : (fabsf(cornerS - 1.0f) < MERGE_EPSILON) ? 1 : -1;
+            int bitT = (fabsf(cornerT) < MERGE_EPSILON) ? 0 : (fabsf(cornerT - 1.0f) < MERGE_EPSILON) ? 1 : -1;
+            if (bitS < 0 || bitT < 0) break;
+            cornerMask |= 1 << (bitS | (bitT << 1));
+        }
+        if (cornerMask != 0x7 && cornerMask != 0xB && cornerMask != 0xD && cornerMask != 0xE) continue;
+
+        // Find the affine mapping from plane coordinates to texture coordinates
+        Vector2 uv[3] = { texCoord(v[0]), texCoord(v[1]), texCoord(v[2]) };
+        float ds1 = s[1] - s[0], dt1 = tc[1] - tc[0];
+        float ds2 = s[2] - s[0], dt2 = tc[2] - tc[0];
+        float det = ds1 * dt2 - dt1 * ds2;
+        Vector2 du1 = uv[1] - uv[0], du2 = uv[2] - uv[0];
+        Vector2 uvScaleS = (du1 * dt2 - du2 * dt1) / det;
+        Vector2 uvScaleT = (du2 * ds1 - du1 * ds2) / det;
+        Vector2 uvOffset = uv[0] - uvScaleS * s[0] - uvScaleT * tc[0];
+
+        float planeComps[3] = { p[0].x, p[0].y, p[0].z };
+        FaceKey key = {
+            axis,
+            faceNormalComps[axis] > 0.0f,
+            Quantize(planeComps[axis]),
+            { Quantize(uvScaleS.x), Quantize(uvScaleS.y), Quantize(uvScaleT.x), Quantize(uvScaleT.y) },
+            // Offsets that differ by whole numbers look the same when the texture repeats
+            { Quantize(uvOffset.x - floorf(uvOffset.x)) % (int64_t)MERGE_PRECISION, Quantize(uvOffset.y - floorf(uvOffset.y)) % (int64_t)MERGE_PRECISION }
+        };
+
+        FaceGroup& group = groups[key];
+        if (group.cels.empty())
+        {
+            group.plane = planeComps[axis];
+            group.uvScaleS = uvScaleS;
+            group.uvScaleT = uvScaleT;
+        }
+
+        CelFace& cel = group.cels[std::make_pair(celS, celT)];
+        if (cel.count < 2)
+        {
+            cel.triangles[cel.count] = (int)t;
+            cel.cornerMasks[cel.count] = cornerMask;
+            if (cel.count == 0) cel.uvOffset = uvOffset;
+        }
+        ++cel.count;
+    }
+
+    std::vector<bool> removed(triangleCount, false);
+    std::vector<float> newPositions, newTexCoords, newNormals;
+    std::vector<int> newTriangles; // Indices into the new vertex arrays
+    size_t removedCount = 0;
+
+    for (const auto& [key, group] : groups)
+    {
+        // A cel's side is covered if it has two triangles split along the same diagonal
+        int minS = INT32_MAX, minT = INT32_MAX, maxS = INT32_MIN, maxT = INT32_MIN;
+        std::vector<std::pair<int, int>> coveredCels;
+        for (const auto& [coords, cel] : group.cels)
+        {
+            // The corners that each triangle doesn't touch must be opposite each other
+            uint8_t missingCorners = (~cel.cornerMasks[0] | ~cel.cornerMasks[1]) & 0xF;
+            if (cel.count != 2 || (missingCorners != 0x6 && missingCorners != 0x9)) continue;
+
+            coveredCels.push_back(coords);
+            minS = Min(minS, coords.first);
+            maxS = Max(maxS, coords.first);
+            minT = Min(minT, coords.second);
+            maxT = Max(maxT, coords.second);
+        }
+        if (coveredCels.size() < 2) continue;
+
+        int width = maxS - minS + 1, height = maxT - minT + 1;
+        std::vector<bool> mask(width * height, false);
+        for (const auto& [celS, celT] : coveredCels)
+        {
+            mask[(celS - minS) + (celT - minT) * width] = true;
+        }
+
+        // Grow rectangles greedily, first along S and then along T
+        for (int t = 0; t < height; ++t)
+        {
+            for (int s = 0; s < width; ++s)
+            {
+                if (!mask[s + t * width]) continue;
+
+                int w = 1;
+                while (s + w < width && mask[(s + w) + t * width]) ++w;
+
+                int h = 1;
+                for (bool rowCovered = true; t + h < height && rowCovered; )
+                {
+                    for (int x = s; x < s + w; ++x)
+                    {
+                        if (!mask[x + (t + h) * width]) rowCovered = false;
+                    }
+                    if (rowCovered) ++h;
+                }
+
+                for (int y = t; y < t + h; ++y)
+                {
+                    for (int x = s; x < s + w; ++x)
+                    {
+                        mask[x + y * width] = false;
+                    }
+                }
+
+                // Single cels are left as they are
+                if (w * h == 1) continue;
+
+                const CelFace& firstCel = group.cels.at(std::make_pair(minS + s, minT + t));
+                for (int y = t; y < t + h; ++y)
+                {
+                    for (int x = s; x < s + w; ++x)
+                    {
+                        const CelFace& cel = group.cels.at(std::make_pair(minS + x, minT + y));
+                        removed[cel.triangles[0]] = true;
+                        removed[cel.triangles[1]] = true;
+                    }
+                }
+                removedCount += 2 * (w * h) - 2;
+
+                // Make the corners of the rectangle, in the order (0, 0), (1, 0), (1, 1), (0, 1) along the plane's axes
+                int axisS = (key.axis + 1) % 3, axisT = (key.axis + 2) % 3;
+                int firstVertex = newPositions.size() / 3;
+                const int cornerS[4] = { 0, w, w, 0 };
+                const int cornerT[4] = { 0, 0, h, h };
+                for (int c = 0; c < 4; ++c)
+                {
+                    float cs = (minS + s + cornerS[c]) * spacing;
+                    float ct = (minT + t + cornerT[c]) * spacing;
+                    float comps[3];
+                    comps[key.axis] = group.plane;
+                    comps[axisS] = cs;
+                    comps[axisT] = ct;
+                    newPositions.insert(newPositions.end(), { comps[0], comps[1], comps[2] });
+
+                    float normalComps[3] = { 0.0f, 0.0f, 0.0f };
+                    normalComps[key.axis] = key.positive ? 1.0f : -1.0f;
+                    newNormals.insert(newNormals.end(), { normalComps[0], normalComps[1], normalComps[2] });
+
+                    Vector2 uv = firstCel.uvOffset + group.uvScaleS * cs + group.uvScaleT * ct;
+                    newTexCoords.insert(newTexCoords.end(), { uv.x, uv.y });
+                }
+
+                // The S axis crossed with the T axis points along the positive direction of the face's axis
+                if (key.positive)
+                    newTriangles.insert(newTriangles.end(), { firstVertex, firstVertex + 1, firstVertex + 2, firstVertex, firstVertex + 2, firstVertex + 3 });
+                else
+                    newTriangles.insert(newTriangles.end(), { firstVertex, firstVertex + 2, firstVertex + 1, firstVertex, firstVertex + 3, firstVertex + 2 });
+            }
+        }
+    }
+
+    if (removedCount == 0) return 0;
+
+    // Rebuild the mesh with only the vertices that are still in use, followed by the new ones.
+    TileMesh result;
+    result.texture = mesh.texture;
+    std::vector<int> remap(mesh.positions.size() / 3, -1);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        if (removed[t]) continue;
+        for (int c = 0; c < 3; ++c)
+        {
+            int v = mesh.indices[t * 3 + c];
+            if (remap[v] < 0)
+            {
+                remap[v] = result.positions.size() / 3;
+                result.positions.insert(result.positions.end(), mesh.positions.begin() + v * 3, mesh.positions.begin() + v * 3 + 3);
+                result.normals.insert(result.normals.end(), mesh.normals.begin() + v * 3, mesh.normals.begin() + v * 3 + 3);
+                result.texCoords.insert(result.texCoords.end(), mesh.texCoords.begin() + v * 2, mesh.texCoords.begin() + v * 2 + 2);
+            }
+            result.indices.push_back((unsigned short)remap[v]);
+        }
+    }
+
+    int newBase = result.positions.size() / 3;
+    result.positions.insert(result.positions.end(), newPositions.begin(), newPositions.end());
+    result.normals.insert(result.normals.end(), newNormals.begin(), newNormals.end());
+    result.texCoords.insert(result.texCoords.end(), newTexCoords.begin(), newTexCoords.end());
+    for (int index : newTriangles)
+    {
+        result.indices.push_back((unsigned short)(newBase + index));
+    }
+
+    mesh = std::move(result);
+    return removedCount;
+}
+
+// Moves vertex `v` of the mesh to `remap[v]`, or drops it if that's negative.
+static void RemapVertices(TileMesh& mesh, const std::vector<int>& remap, int newVertexCount)
+{
+    std::vector<float> positions(newVertexCount * 3), normals(newVertexCount * 3), texCoords(newVertexCount * 2);
+    for (size_t v = 0; v < remap.size(); ++v)
+    {
+        if (remap[v] < 0) continue;
+        std::copy_n(mesh.positions.begin() + v * 3, 3, positions.begin() + remap[v] * 3);
+        std::copy_n(mesh.normals.begin() + v * 3, 3, normals.begin() + remap[v] * 3);
+        std::copy_n(mesh.texCoords.begin() + v * 2, 2, texCoords.begin() + remap[v] * 2);
+    }
+    for (unsigned short& index : mesh.indices)
+    {
+        index = (unsigned short)remap[index];
+    }
+    mesh.positions = std::move(positions);
+    mesh.normals = std::move(normals);
+    mesh.texCoords = std::move(texCoords);
+}
+
+// The exact bits of a vertex's position, normal, and texture coordinates
+struct VertexKey
+{
+    std::array<uint32_t, 8> bits;
+
+    inline bool operator==(const VertexKey& other) const { return bits == other.bits; }
+};
+
+struct VertexKeyHash
+{
+    inline size_t operator()(const VertexKey& key) const
+    {
+        // FNV-1a over the words
+        uint64_t hash = 14695981039346656037ULL;
+        for (uint32_t word : key.bits)
+        {
+            hash = (hash ^ word) * 1099511628211ULL;
+        }
+        return (size_t)hash;
+    }
+};
+
+size_t WeldVertices(TileMesh& mesh)
+{
+    const int vertexCount = mesh.positions.size() / 3;
+    std::unordered_map<VertexKey, int, VertexKeyHash> vertexIDs;
+    vertexIDs.reserve(vertexCount);
+
+    // Vertices are numbered in the order that the triangles use them, so unused ones are left out.
+    std::vector<int> remap(vertexCount, -1);
+    int newVertexCount = 0;
+    for (unsigned short index : mesh.indices)
+    {
+        if (remap[index] >= 0) continue;
+
+        const float values[8] = {
+            mesh.positions[index * 3], mesh.positions[index * 3 + 1], mesh.positions[index * 3 + 2],
+            mesh.normals[index * 3], mesh.normals[index * 3 + 1], mesh.normals[index * 3 + 2],
+            mesh.texCoords[index * 2], mesh.texCoords[index * 2 + 1]
+        };
+        VertexKey key;
+        for (int i = 0; i < 8; ++i)
+        {
+            // Negative zero would otherwise keep vertices apart.
+            float value = (values[i] == 0.0f) ? 0.0f : values[i];
+            memcpy(&key.bits[i], &value, sizeof(float));
+        }
+
+        auto [iter, isNew] = vertexIDs.emplace(key, newVertexCount);
+        if (isNew) ++newVertexCount;
+        remap[index] = iter->second;
+    }
+
+    RemapVertices(mesh, remap, newVertexCount);
+    return vertexCount - newVertexCount;
+}
+
+void OptimizeVertexCache(TileMesh& mesh, int cacheSize)
+{
+    const int vertexCount = mesh.positions.size() / 3;
+    const int triangleCount = mesh.indices.size() / 3;
+    if (triangleCount == 0) return;
+
+    // The triangles that use each vertex, all in one array
+    std::vector<int> liveTriangles(vertexCount, 0);
+    for (unsigned short index : mesh.indices)
+    {
+        ++liveTriangles[index];
+    }
+    std::vector<int> adjacencyOffsets(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+    }
+    std::vector<int> adjacency(mesh.indices.size());
+    std::vector<int> adjacencyEnds(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < mesh.indices.size(); ++i)
+    {
+        adjacency[adjacencyEnds[mesh.indices[i]]++] = i / 3;
+    }
+
+    std::vector<int> cacheTimes(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<int> deadEnds; // Recently used vertices, to continue from when the fanning vertex runs out of neighbors
+    std::vector<int> candidates;
+    std::vector<unsigned short> newIndices;
+    newIndices.reserve(mesh.indices.size());
+    int time = cacheSize + 1;
+    int cursor = 0;
+
+    // Finds a vertex that still has triangles left, first from the recently used ones and then in input order.
+    auto skipDeadEnd = [&]()
+    {
+        while (!deadEnds.empty())
+        {
+            int v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[v] > 0) return v;
+        }
+        for (; cursor < vertexCount; ++cursor)
+        {
+            if (liveTriangles[cursor] > 0) return cursor;
+        }
+        return -1;
+    };
+
+    for (int fan = skipDeadEnd(); fan >= 0; )
+    {
+        // Emit all of the remaining triangles around the fanning vertex
+        candidates.clear();
+        for (int a = adjacencyOffsets[fan]; a < adjacencyOffsets[fan + 1]; ++a)
+        {
+            int t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+
+            for (int c = 0; c < 3; ++c)
+            {
+                int v = mesh.indices[t * 3 + c];
+                newIndices.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --liveTriangles[v];
+                if (time - cacheTimes[v] > cacheSize)
+                {
+                    cacheTimes[v] = time;
+                    ++time;
+                }
+            }
+        }
+
+        // Fan around the neighbor that has been in the cache the longest, 
+        // as long as it will still be there after its remaining triangles are emitted.
+        int next = -1, bestPriority = -1;
+        for (int v : candidates)
+        {
+            if (liveTriangles[v] <= 0) continue;
+            int priority = 0;
+            if (time - cacheTimes[v] + 2 * liveTriangles[v] <= cacheSize) priority = time - cacheTimes[v];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+        fan = (next >= 0) ? next : skipDeadEnd();
+    }
+    mesh.indices = std::move(newIndices);
+
+    // Storing the vertices in the order they're used makes fetching them more cache friendly too.
+    std::vector<int> remap(vertexCount, -1);
+    int newVertexCount = 0;
+    for (unsigned short index : mesh.indices)
+    {
+        if (remap[index] < 0) remap[index] = newVertexCount++;
+    }
+    RemapVertices(mesh, remap, newVertexCount);
+}
+
+size_t CountCacheMisses(const TileMesh& mesh, int cacheSize)
+{
+    // With a FIFO cache, a vertex is evicted once `cacheSize` other vertices have been loaded after it.
+    std::vector<size_t> loadedAt(mesh.positions.size() / 3, SIZE_MAX);
+    size_t misses = 0;
+    for (unsigned short index : mesh.indices)
+    {
+        if (loadedAt[index] == SIZE_MAX || misses - loadedAt[index] >= (size_t)cacheSize)
+        {
+            loadedAt[index] = misses;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+// A vertex with all of its attributes, for clipping polygons
+struct ClipVertex
+{
+    Vector3 position;
+    Vector3 normal;
+    Vector2 texCoord;
+};
+
+// Cuts off the part of the polygon where the texture coordinate (0 for U, 1 for V) is below `bound`, or above it if `keepBelow` is true.
+static void ClipPolygon(const std::vector<ClipVertex>& polygon, std::vector<ClipVertex>& outPolygon, int component, float bound, bool keepBelow)
+{
+    auto distance = [&](const ClipVertex& vertex){ 
+        float d = ((component == 0) ? vertex.texCoord.x : vertex.texCoord.y) - bound;
+        return keepBelow ? -d : d;
+    };
+
+    outPolygon.clear();
+    for (size_t i = 0; i < polygon.size(); ++i)
+    {
+        const ClipVertex& a = polygon[i];
+        const ClipVertex& b = polygon[(i + 1) % polygon.size()];
+        float da = distance(a), db = distance(b);
+        if (da >= 0.0f) outPolygon.push_back(a);
+        if ((da > 0.0f && db < 0.0f) || (da < 0.0f && db > 0.0f))
+        {
+            float t = da / (da - db);
+            outPolygon.push_back(ClipVertex {
+                Vector3Lerp(a.position, b.position, t),
+                Vector3Normalize(Vector3Lerp(a.normal, b.normal, t)),
+                Vector2Lerp(a.texCoord, b.texCoord, t)
+            });
+        }
+    }
+}
+
+void AppendInAtlasSpace(const TileMesh& mesh, Rectangle uvRect, TexID atlasPage, std::vector<TileMesh>& outMeshes)
+{
+    auto vertex = [&](int v){
+        return ClipVertex {
+            Vector3 { mesh.positions[v * 3], mesh.positions[v * 3 + 1], mesh.positions[v * 3 + 2] },
+            Vector3 { mesh.normals[v * 3], mesh.normals[v * 3 + 1], mesh.normals[v * 3 + 2] },
+            Vector2 { mesh.texCoords[v * 2], mesh.texCoords[v * 2 + 1] }
+        };
+    };
+
+    // Vertices that have already been added to the output mesh, by their original index and the repetition of the texture they're in.
+    std::map<std::tuple<int, int, int>, int> addedVertices;
+    auto startMesh = [&](){
+        outMeshes.emplace_back();
+        outMeshes.back().texture = atlasPage;
+        addedVertices.clear();
+    };
+    if (outMeshes.empty()) startMesh();
+
+    // Adds a vertex to the output mesh, with the texture coordinates of the given repetition mapped into the atlas region.
+    auto addVertex = [&](const ClipVertex& vertex, int repeatU, int repeatV){
+        TileMesh& out = outMeshes.back();
+        int index = out.positions.size() / 3;
+        out.positions.insert(out.positions.end(), { vertex.position.x, vertex.position.y, vertex.position.z });
+        out.normals.insert(out.normals.end(), { vertex.normal.x, vertex.normal.y, vertex.normal.z });
+        out.texCoords.insert(out.texCoords.end(), { 
+            uvRect.x + Clamp(vertex.texCoord.x - repeatU, 0.0f, 1.0f) * uvRect.width, 
+            uvRect.y + Clamp(vertex.texCoord.y - repeatV, 0.0f, 1.0f) * uvRect.height
+        });
+        return index;
+    };
+
+    std::vector<ClipVertex> polygon, clipped;
+    for (size_t t = 0; t < mesh.indices.size() / 3; ++t)
+    {
+        int v[3] = { mesh.indices[t * 3], mesh.indices[t * 3 + 1], mesh.indices[t * 3 + 2] };
+        ClipVertex triangle[3] = { vertex(v[0]), vertex(v[1]), vertex(v[2]) };
+
+        // Find the range of repetitions of the texture that the triangle covers
+        float minU = Minf(triangle[0].texCoord.x, Minf(triangle[1].texCoord.x, triangle[2].texCoord.x));
+        float maxU = Maxf(triangle[0].texCoord.x, Maxf(triangle[1].texCoord.x, triangle[2].texCoord.x));
+        float minV = Minf(triangle[0].texCoord.y, Minf(triangle[1].texCoord.y, triangle[2].texCoord.y));
+        float maxV = Maxf(triangle[0].texCoord.y, Maxf(triangle[1].texCoord.y, triangle[2].texCoord.y));
+        int firstU = (int)floorf(minU + MERGE_EPSILON), lastU = Max(firstU, (int)ceilf(maxU - MERGE_EPSILON) - 1);
+        int firstV = (int)floorf(minV + MERGE_EPSILON), lastV = Max(firstV, (int)ceilf(maxV - MERGE_EPSILON) - 1);
+        int repetitions = (lastU - firstU + 1) * (lastV - firstV + 1);
+
+        // A triangle clipped to a square can have up to 7 corners
+        if (outMeshes.back().positions.size() / 3 + repetitions * 7 > (size_t)UINT16_MAX + 1)
+        {
+            startMesh();
+        }
+        TileMesh& out = outMeshes.back();
+
+        if (repetitions == 1)
+        {
+            // Vertices are shared between triangles that don't need to be split
+            for (int c = 0; c < 3; ++c)
+            {
+                auto [iter, isNew] = addedVertices.emplace(std::make_tuple(v[c], firstU, firstV), 0);
+                if (isNew) iter->second = addVertex(triangle[c], firstU, firstV);
+                out.indices.push_back((unsigned short)iter->second);
+            }
+            continue;
+        }
+
+        for (int repeatV = firstV; repeatV <= lastV; ++repeatV)
+        {
+            for (int repeatU = firstU; repeatU <= lastU; ++repeatU)
+            {
+                polygon.assign(triangle, triangle + 3);
+                ClipPolygon(polygon, clipped, 0, (float)repeatU, false);
+                ClipPolygon(clipped, polygon, 0, (float)(repeatU + 1), true);
+                ClipPolygon(polygon, clipped, 1, (float)repeatV, false);
+                ClipPolygon(clipped, polygon, 1, (float)(repeatV + 1), true);
+                if (polygon.size() < 3) continue;
+
+                // Skip slivers left by triangles that only touch this repetition
+                float area = 0.0f;
+                for (size_t i = 0; i < polygon.size(); ++i)
+                {
+                    const Vector2& a = polygon[i].texCoord;
+                    const Vector2& b = polygon[(i + 1) % polygon.size()].texCoord;
+                    area += a.x * b.y - b.x * a.y;
+                }
+                if (fabsf(area) < MERGE_EPSILON) continue;
+
+                // Turn the polygon back into triangles, fanning out from the first corner
+                int firstVertex = out.positions.size() / 3;
+                for (const ClipVertex& corner : polygon)
+                {
+                    addVertex(corner, repeatU, repeatV);
+                }
+                for (size_t i = 1; i + 1 < polygon.size(); ++i)
+                {
+                    out.indices.insert(out.indices.end(), { 
+                        (unsigned short)firstVertex, (unsigned short)(firstVertex + i), (unsigned short)(firstVertex + i + 1) 
+                    });
+                }
+            }
+        }
+    }
+}
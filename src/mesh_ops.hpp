@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2022-present Alexander Lunsford
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#ifndef MESH_OPS_H
+#define MESH_OPS_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "tile.hpp"
+
+// Post-processing passes over the geometry generated from tiles, used when exporting.
+
+// Combines adjacent square faces that each cover one whole side of a grid cel into larger rectangles.
+// Faces are only combined if they are axis-aligned, coplanar, face the same way, have flat normals, 
+// and their texture coordinates line up when the texture is repeated.
+// Returns the number of triangles that were removed.
+size_t MergeCoplanarFaces(TileMesh& mesh, float spacing);
+
+// Number of vertices that the simulated post-transform cache holds
+#define VERTEX_CACHE_SIZE 16
+
+// Combines vertices whose position, normal, and texture coordinates are exactly the same, and removes unused vertices.
+// Returns the number of vertices that were removed.
+size_t WeldVertices(TileMesh& mesh);
+
+// Reorders the triangles so that vertices are reused while they are still in the GPU's vertex cache,
+// using the Tipsify algorithm (Sander et al. 2007), then puts the vertices in the order they are first used.
+void OptimizeVertexCache(TileMesh& mesh, int cacheSize = VERTEX_CACHE_SIZE);
+
+// Counts how many vertices would have to be transformed by a FIFO cache of the given size.
+// Dividing this by the number of triangles gives the average cache miss ratio (ACMR).
+size_t CountCacheMisses(const TileMesh& mesh, int cacheSize = VERTEX_CACHE_SIZE);
+
+// Adds the mesh's triangles to the last of `outMeshes` with their texture coordinates moved into `uvRect`, a region of a texture atlas.
+// Since the region can't repeat, triangles whose texture coordinates go past the edges of the texture are split at each repetition.
+// A new mesh for the atlas page is started whenever the last one would have too many vertices for 16 bit indices.
+void AppendInAtlasSpace(const TileMesh& mesh, Rectangle uvRect, TexID atlasPage, std::vector<TileMesh>& outMeshes);
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2022-present Alexander Lunsford
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+
+// Calls `work(i)` for every i in [0, count), spread over as many threads as the hardware has.
+// The calling thread does some of the work too. If any call throws, the remaining items are skipped
+// and the first exception is rethrown once all threads have stopped.
+template<typename F>
+void ParallelFor(size_t count, const F& work)
+{
+    std::atomic<size_t> next = 0;
+    std::atomic<bool> failed = false;
+    std::exception_ptr error = nullptr;
+    auto worker = [&]()
+    {
+        try
+        {
+            for (size_t i = next++; i < count && !failed; i = next++)
+            {
+                work(i);
+            }
+        }
+        catch (...)
+        {
+            // Only the first error is kept
+            if (!failed.exchange(true)) error = std::current_exception();
+        }
+    };
+
+    size_t numThreads = std::min(count, std::max((size_t)std::thread::hardware_concurrency(), (size_t)1));
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < numThreads; ++t)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    if (error != nullptr) std::rethrow_exception(error);
+}
+
+#endif
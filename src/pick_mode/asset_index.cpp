@@ -0,0 +1,265 @@
+/**
+ * Copyright (c) 2022-present Alexander Lunsford
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#include "asset_index.hpp"
+
+#include "json.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "../text_util.hpp"
+
+#define ASSET_INDEX_VERSION 1
+
+static int64_t FileTimeToInt(fs::file_time_type time)
+{
+    return (int64_t)time.time_since_epoch().count();
+}
+
+AssetIndex::AssetIndex(fs::path indexFilePath)
+    : _indexFilePath(indexFilePath),
+      _loaded(false),
+      _dirty(false),
+      _hideRegexCompiled(false)
+{
+}
+
+void AssetIndex::Load()
+{
+    if (_loaded) return;
+    _loaded = true;
+
+    std::ifstream file(_indexFilePath);
+    if (!file.is_open()) return;
+
+    try
+    {
+        nlohmann::json jData;
+        file >> jData;
+        if (jData.value("version", 0) != ASSET_INDEX_VERSION) return;
+
+        _hideRegexString = jData.at("hideRegex").get<std::string>();
+        for (const auto& [dirPath, jDir] : jData.at("dirs").items())
+        {
+            DirRecord dir;
+            dir.modifiedTime = jDir.at("mtime").get<int64_t>();
+            dir.subdirs = jDir.at("subdirs").get<std::vector<std::string>>();
+            for (const nlohmann::json& jFile : jDir.at("files"))
+            {
+                dir.files.push_back(FileRecord {
+                    .name = jFile.at("name").get<std::string>(),
+                    .extension = jFile.at("ext").get<std::string>(),
+                    .modifiedTime = jFile.at("mtime").get<int64_t>(),
+                    .hidden = jFile.at("hidden").get<bool>(),
+                });
+            }
+            _dirs[dirPath] = std::move(dir);
+        }
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Asset index at " << _indexFilePath << " is invalid and will be rebuilt: " << ex.what() << std::endl;
+        _dirs.clear();
+        _hideRegexString.clear();
+    }
+}
+
+void AssetIndex::Save()
+{
+    if (!_dirty) return;
+
+    try
+    {
+        nlohmann::json jDirs = nlohmann::json::object();
+        for (const auto& [dirPath, dir] : _dirs)
+        {
+            nlohmann::json jFiles = nlohmann::json::array();
+            for (const FileRecord& file : dir.files)
+            {
+                jFiles.push_back({
+                    {"name", file.name},
+                    {"ext", file.extension},
+                    {"mtime", file.modifiedTime},
+                    {"hidden", file.hidden},
+                });
+            }
+            jDirs[dirPath] = {
+                {"mtime", dir.modifiedTime},
+                {"subdirs", dir.subdirs},
+                {"files", jFiles},
+            };
+        }
+
+        nlohmann::json jData = {
+            {"version", ASSET_INDEX_VERSION},
+            {"hideRegex", _hideRegexString},
+            {"dirs", jDirs},
+        };
+
+        std::ofstream file(_indexFilePath);
+        file << jData;
+        if (file.fail()) 
+        {
+            std::cerr << "Error writing asset index to " << _indexFilePath << std::endl;
+            return;
+        }
+        _dirty = false;
+    }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "Error saving asset index: " << ex.what() << std::endl;
+    }
+}
+
+std::set<fs::path> AssetIndex::GetFiles(const fs::path& rootDir, const std::string& extension, const std::string& hideRegex)
+{
+    Load();
+
+    if (!_hideRegexCompiled || hideRegex != _hideRegexString)
+    {
+        _SetHideRegex(hideRegex);
+    }
+
+    std::set<std::string> visited;
+    _Refresh(rootDir, visited);
+
+    // Forget about directories in this tree that have been deleted.
+    const std::string rootString = rootDir.string();
+    for (auto iter = _dirs.lower_bound(rootString); iter != _dirs.end() && iter->first.compare(0, rootString.size(), rootString) == 0;)
+    {
+        if (_IsInTree(iter->first, rootString) && visited.find(iter->first) == visited.end())
+        {
+            iter = _dirs.erase(iter);
+            _dirty = true;
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+
+    std::set<fs::path> files;
+    for (const std::string& dirPath : visited)
+    {
+        auto dirIter = _dirs.find(dirPath);
+        if (dirIter == _dirs.end()) continue;
+        for (const FileRecord& file : dirIter->second.files)
+        {
+            if (file.hidden || file.extension != extension) continue;
+            files.insert(fs::path(dirPath) / file.name);
+        }
+    }
+    return files;
+}
+
+void AssetIndex::_Refresh(const fs::path& dirPath, std::set<std::string>& visited)
+{
+    const std::string key = dirPath.string();
+    if (!visited.insert(key).second) return;
+
+    std::error_code err;
+    int64_t modifiedTime = FileTimeToInt(fs::last_write_time(dirPath, err));
+    if (err) return;
+
+    auto dirIter = _dirs.find(key);
+    if (dirIter == _dirs.end() || dirIter->second.modifiedTime != modifiedTime)
+    {
+        // The directory's entries have changed (or it's new), so it has to be listed again.
+        DirRecord dir;
+        dir.modifiedTime = modifiedTime;
+        for (const fs::directory_entry& entry : fs::directory_iterator(dirPath, err))
+        {
+            std::error_code entryErr;
+            if (entry.is_directory(entryErr) && !entry.is_symlink(entryErr))
+            {
+                dir.subdirs.push_back(entry.path().filename().string());
+            }
+            else if (entry.is_regular_file(entryErr))
+            {
+                dir.files.push_back(FileRecord {
+                    .name = entry.path().filename().string(),
+                    .extension = StringToLower(entry.path().extension().string()),
+                    .modifiedTime = FileTimeToInt(entry.last_write_time(entryErr)),
+                    .hidden = _IsHidden(entry.path()),
+                });
+            }
+        }
+        if (err) return;
+
+        _dirs[key] = std::move(dir);
+        _dirty = true;
+    }
+
+    for (const std::string& subdir : _dirs[key].subdirs)
+    {
+        _Refresh(dirPath / subdir, visited);
+    }
+}
+
+void AssetIndex::_SetHideRegex(const std::string& hideRegex)
+{
+    _hideRegexCompiled = true;
+    try 
+    {
+        _hideRegex = std::regex(hideRegex, std::regex_constants::icase | std::regex_constants::ECMAScript);
+    }
+    catch (const std::regex_error& err) 
+    {
+        std::cerr << "Error: Invalid assetHideRegex '" << hideRegex << "': " << err.what() << std::endl;
+        std::cerr << __FILE__ << ':' << __LINE__ << std::endl;
+        _hideRegex = std::regex();
+    }
+    catch (...)
+    {
+        std::cerr << "Error: Unknown regex-related error when loading textures." << std::endl;
+        std::cerr << __FILE__ << ':' << __LINE__ << std::endl;
+        _hideRegex = std::regex();
+    }
+
+    if (hideRegex == _hideRegexString) return;
+    _hideRegexString = hideRegex;
+
+    // The hidden flags were calculated with the old regex.
+    for (auto& [dirPath, dir] : _dirs)
+    {
+        for (FileRecord& file : dir.files)
+        {
+            file.hidden = _IsHidden(fs::path(dirPath) / file.name);
+        }
+    }
+    _dirty = true;
+}
+
+bool AssetIndex::_IsInTree(const std::string& dirPath, const std::string& rootPath)
+{
+    if (dirPath.compare(0, rootPath.size(), rootPath) != 0) return false;
+    if (dirPath.size() == rootPath.size()) return true;
+    // Make sure that "tiles" doesn't claim "tiles2".
+    char lastRootChar = rootPath.empty() ? '\0' : rootPath.back();
+    char nextChar = dirPath[rootPath.size()];
+    return lastRootChar == '/' || lastRootChar == '\\' || nextChar == '/' || nextChar == '\\';
+}
+
+bool AssetIndex::_IsHidden(const fs::path& filePath) const
+{
+    return std::regex_match(filePath.string(), _hideRegex);
+}
@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2022-present Alexander Lunsford
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#ifndef ASSET_INDEX_H
+#define ASSET_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <regex>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#define ASSET_INDEX_FILE_PATH "te3_asset_index.json"
+
+// Remembers the contents of the asset directories between visits to the pickers (and between sessions).
+// On refresh, only directories whose modification times have changed are listed again, 
+// so an unchanged asset tree costs one stat per directory.
+class AssetIndex
+{
+public:
+    AssetIndex(fs::path indexFilePath);
+
+    // Reads the index from its file. Does nothing after the first call.
+    void Load();
+    // Writes the index to its file if anything has changed.
+    void Save();
+
+    // Updates the index for the directory tree at `rootDir`, then returns all of the files in it
+    // with the given lower case extension that aren't matched by `hideRegex`.
+    std::set<fs::path> GetFiles(const fs::path& rootDir, const std::string& extension, const std::string& hideRegex);
+protected:
+    struct FileRecord
+    {
+        std::string name;
+        std::string extension; // Lower case
+        int64_t modifiedTime;
+        bool hidden; // True if the full path matches the hidden asset regex
+    };
+
+    struct DirRecord
+    {
+        int64_t modifiedTime;
+        std::vector<std::string> subdirs; // Names, not full paths
+        std::vector<FileRecord> files;
+    };
+
+    // Rereads the directory at `dirPath` if it has changed, then recurses into its subdirectories.
+    // Every directory that is reached gets added to `visited`.
+    void _Refresh(const fs::path& dirPath, std::set<std::string>& visited);
+    // Recalculates the hidden flag of every file in the index.
+    void _SetHideRegex(const std::string& hideRegex);
+    bool _IsHidden(const fs::path& filePath) const;
+    // Returns true if `dirPath` is `rootPath` or one of its subdirectories.
+    static bool _IsInTree(const std::string& dirPath, const std::string& rootPath);
+
+    fs::path _indexFilePath;
+    bool _loaded;
+    bool _dirty;
+
+    std::map<std::string, DirRecord> _dirs; // Keyed by the directory's path
+    std::string _hideRegexString;
+    std::regex _hideRegex;
+    bool _hideRegexCompiled;
+};
+
+#endif
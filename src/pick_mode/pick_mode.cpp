@@ -26,7 +26,8 @@
 #include <cstring>
 #include <iostream>
 #include <stdio.h>
-#include <regex>
+#include <algorithm>
+#include <iterator>
 
 #include "../assets.hpp"
 #include "../text_util.hpp"
@@ -41,21 +42,41 @@ PickMode::Frame::Frame(const fs::path filePath, const fs::path rootDir)
     label = fs::relative(filePath, rootDir).string();
 }
 
-PickMode::PickMode(App::Settings &settings, int maxSelectionCount, std::string fileExtension)
+PickMode::PickMode(App::Settings &settings, AssetIndex &assetIndex, int maxSelectionCount, std::string fileExtension)
     : _settings(settings), 
+      _assetIndex(assetIndex),
       _fileExtension(fileExtension),
-      _maxSelectionCount(maxSelectionCount) 
+      _maxSelectionCount(maxSelectionCount),
+      _uploadBudget(ICON_UPLOADS_PER_FRAME),
+      _placeholderTexture(Texture { 0 })
 {
     memset(_searchFilterBuffer, 0, sizeof(char) * SEARCH_BUFFER_SIZE);
+    memset(_searchFilterPrevious, 0, sizeof(char) * SEARCH_BUFFER_SIZE);
+}
+
+PickMode::~PickMode()
+{
+    if (IsTextureValid(_placeholderTexture)) UnloadTexture(_placeholderTexture);
+}
+
+// Packs three characters of `str`, starting at `index`, into one integer.
+static uint32_t Trigram(const std::string& str, size_t index)
+{
+    return (uint32_t)(uint8_t)str[index] 
+        | ((uint32_t)(uint8_t)str[index + 1] << 8) 
+        | ((uint32_t)(uint8_t)str[index + 2] << 16);
 }
 
 void PickMode::_GetFrames()
 {
     _frames.clear();
+    _trigramIndex.clear();
 
+    _frames.reserve(_foundFiles.size());
     for (const fs::path& path : _foundFiles)
     {
         Frame frame(path, _rootDir);
+        frame.lowerCaseLabel = StringToLower(frame.label);
         frame.texture = Texture {
             .id = 0,
             .width = ICON_SIZE,
@@ -64,59 +85,122 @@ void PickMode::_GetFrames()
             .format = 0,
         };
 
-        // Filter out files that don't contain the search term
-        std::string lowerCaseLabel = StringToLower(frame.label);
-        if (strlen(_searchFilterBuffer) > 0 && 
-            lowerCaseLabel.find(StringToLower(std::string(_searchFilterBuffer))) == std::string::npos)
+        const size_t frameIndex = _frames.size();
+        for (size_t c = 0; c + 2 < frame.lowerCaseLabel.length(); ++c)
         {
-            continue;
+            std::vector<size_t>& frameIndices = _trigramIndex[Trigram(frame.lowerCaseLabel, c)];
+            // Frames are added in order, so this is enough to keep the lists sorted and free of duplicates.
+            if (frameIndices.empty() || frameIndices.back() != frameIndex) frameIndices.push_back(frameIndex);
         }
 
         _frames.push_back(frame);
     }
+
+    // Forces the search to start over
+    _searchFilterPrevious[0] = '\0';
+    _FilterFrames();
 }
 
-void PickMode::OnEnter()
+void PickMode::_FilterFrames()
 {
-    std::regex hiddenFileRegex;
-    try 
+    _visibleFiles.clear();
+
+    const std::string query = StringToLower(std::string(_searchFilterBuffer));
+    const std::string previousQuery = StringToLower(std::string(_searchFilterPrevious));
+    strcpy(_searchFilterPrevious, _searchFilterBuffer);
+
+    if (query.empty())
+    {
+        _filteredFrames.resize(_frames.size());
+        for (size_t f = 0; f < _frames.size(); ++f) _filteredFrames[f] = f;
+        return;
+    }
+
+    // Find the smallest set of frames that could contain the search term.
+    // If the new search term contains the previous one, then only the previous results can match.
+    std::vector<size_t> candidates;
+    bool narrowing = !previousQuery.empty() && query.find(previousQuery) != std::string::npos;
+    if (narrowing) candidates = _filteredFrames;
+
+    if (query.length() >= 3)
+    {
+        // Every frame that matches must contain all of the query's trigrams, so intersect their lists, shortest first.
+        std::vector<const std::vector<size_t>*> lists;
+        for (size_t c = 0; c + 2 < query.length(); ++c)
+        {
+            auto iter = _trigramIndex.find(Trigram(query, c));
+            if (iter == _trigramIndex.end())
+            {
+                _filteredFrames.clear();
+                return;
+            }
+            lists.push_back(&iter->second);
+        }
+        std::sort(lists.begin(), lists.end(), 
+            [](const std::vector<size_t>* a, const std::vector<size_t>* b){ return a->size() < b->size(); });
+
+        if (!narrowing || lists[0]->size() < candidates.size())
+        {
+            candidates = *lists[0];
+            narrowing = true;
+        }
+        for (size_t l = 1; l < lists.size() && !candidates.empty(); ++l)
+        {
+            std::vector<size_t> intersection;
+            std::set_intersection(candidates.begin(), candidates.end(), lists[l]->begin(), lists[l]->end(), std::back_inserter(intersection));
+            candidates.swap(intersection);
+        }
+    }
+
+    if (!narrowing)
     {
-        hiddenFileRegex = std::regex(_settings.assetHideRegex, std::regex_constants::icase | std::regex_constants::ECMAScript);
+        candidates.resize(_frames.size());
+        for (size_t f = 0; f < _frames.size(); ++f) candidates[f] = f;
     }
-    catch (const std::regex_error& err) 
+
+    // The trigrams don't account for their order, so the candidates still have to be checked.
+    _filteredFrames.clear();
+    for (size_t f : candidates)
     {
-        std::cerr << "Error: Invalid assetHideRegex '" << _settings.assetHideRegex << "': " << err.what() << std::endl;
-        std::cerr << __FILE__ << ':' << __LINE__ << std::endl;
+        if (_frames[f].lowerCaseLabel.find(query) != std::string::npos)
+        {
+            _filteredFrames.push_back(f);
+        }
     }
-    catch (...)
+}
+
+void PickMode::OnEnter()
+{
+    if (!IsTextureValid(_placeholderTexture))
     {
-        std::cerr << "Error: Unknown regex-related error when loading textures." << std::endl;
-        std::cerr << __FILE__ << ':' << __LINE__ << std::endl;
+        Image placeholderImage = GenImageColor(ICON_SIZE, ICON_SIZE, DARKGRAY);
+        _placeholderTexture = LoadTextureFromImage(placeholderImage);
+        UnloadImage(placeholderImage);
     }
 
-    // Get the paths to all assets if this hasn't been done already.
-    _foundFiles.clear();
+    // Get the paths to all assets from the index, which only rereads directories that have changed.
     if (!fs::is_directory(_rootDir)) 
     {
         std::cerr << "Asset directory in settings is not a directory!" << std::endl;
+        _foundFiles.clear();
+        _GetFrames();
         return;
     }
-    
-    for (auto const& entry : fs::recursive_directory_iterator{_rootDir})
-    {
-        if (entry.is_directory() || !entry.is_regular_file()) continue;
 
-        //Filter out files with the wrong extensions
-        std::string extensionStr = StringToLower(entry.path().extension().string());
-        if (extensionStr != _fileExtension || std::regex_match(entry.path().string(), hiddenFileRegex)) 
-        {
-            continue;
-        }
+    std::set<fs::path> foundFiles = _assetIndex.GetFiles(_rootDir, _fileExtension, _settings.assetHideRegex);
+    _assetIndex.Save();
 
-        _foundFiles.insert(entry.path());
+    if (foundFiles != _foundFiles || _frames.empty())
+    {
+        _foundFiles = std::move(foundFiles);
+        _GetFrames();
+    }
+    else
+    {
+        // The icons were unloaded when the mode was exited, but the frames and search index are still good.
+        for (Frame& frame : _frames) frame.texture.id = 0;
+        _visibleFiles.clear();
     }
-
-    _GetFrames();
 }
 
 void PickMode::Update()
@@ -140,7 +224,7 @@ void PickMode::Draw()
         
         if (ImGui::InputText("Search", _searchFilterBuffer, SEARCH_BUFFER_SIZE))
         {
-            _GetFrames();
+            _FilterFrames();
         }
 
         ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(4.0, 8.0));
@@ -148,61 +232,76 @@ void PickMode::Draw()
         ImGui::PopStyleVar(1);
         
         const int NUM_COLS = Max((int)((windowSize.x) / (FRAME_SIZE * 1.5f)), 1);
-        const int NUM_ROWS = Max((int)ceilf(_frames.size() / (float)NUM_COLS), 1);
+        const int NUM_ROWS = Max((int)ceilf(_filteredFrames.size() / (float)NUM_COLS), 1);
         
+        _uploadBudget = ICON_UPLOADS_PER_FRAME;
+        _visibleFiles.clear();
+
         if (ImGui::BeginTable("##Frames", NUM_COLS, ImGuiTableFlags_BordersOuter | ImGuiTableFlags_ScrollY))
         {
-            for (int r = 0; r < NUM_ROWS; ++r)
+            // Only the rows that are scrolled into view are submitted, so large asset libraries don't slow down the UI.
+            ImGuiListClipper clipper;
+            clipper.Begin(NUM_ROWS);
+            while (clipper.Step())
             {
-                ImGui::TableNextRow();
-                for (int c = 0; c < NUM_COLS; ++c)
+                for (int r = clipper.DisplayStart; r < clipper.DisplayEnd; ++r)
                 {
-                    ImGui::TableNextColumn();
+                    ImGui::TableNextRow();
+                    for (int c = 0; c < NUM_COLS; ++c)
+                    {
+                        ImGui::TableNextColumn();
 
-                    size_t frameIndex = c + r * NUM_COLS;
-                    if (frameIndex >= _frames.size()) break;
+                        size_t filterIndex = c + r * NUM_COLS;
+                        if (filterIndex >= _filteredFrames.size()) break;
+                        size_t frameIndex = _filteredFrames[filterIndex];
 
-                    fs::path filePath = _frames[frameIndex].filePath;
-                    
-                    ImColor color = ImColor(1.0f, 1.0f, 1.0f);
-                    if (IsFrameSelected(_frames[frameIndex].filePath))
-                    {
-                        // Set color when selected to yellow
-                        color = ImColor(1.0f, 1.0f, 0.0f);
-                    }
+                        fs::path filePath = _frames[frameIndex].filePath;
+                        
+                        ImColor color = ImColor(1.0f, 1.0f, 1.0f);
+                        if (IsFrameSelected(_frames[frameIndex].filePath))
+                        {
+                            // Set color when selected to yellow
+                            color = ImColor(1.0f, 1.0f, 0.0f);
+                        }
 
-                    ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(color));
+                        ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(color));
 
-                    Texture* frameTexture = &_frames[frameIndex].texture;
-                    
-                    float left = 0.0f, top = 0.0f, right = 1.0f, bottom = 1.0f;
-                    ImGui::ImageButton(
-                        filePath.string().c_str(), (ImTextureID)frameTexture,
-                        ImVec2(ICON_SIZE, ICON_SIZE),
-                        ImVec2(left, top), ImVec2(right, bottom)
-                    );
+                        Texture* frameTexture = &_frames[frameIndex].texture;
+                        if (!IsTextureValid(*frameTexture)) frameTexture = &_placeholderTexture;
+                        
+                        float left = 0.0f, top = 0.0f, right = 1.0f, bottom = 1.0f;
+                        ImGui::ImageButton(
+                            filePath.string().c_str(), (ImTextureID)frameTexture,
+                            ImVec2(ICON_SIZE, ICON_SIZE),
+                            ImVec2(left, top), ImVec2(right, bottom)
+                        );
 
-                    if (ImGui::IsItemHovered() && (ImGui::IsMouseReleased(ImGuiMouseButton_Left) || ImGui::IsMouseReleased(ImGuiMouseButton_Right)))
-                    {
-                        SelectFrame(_frames[frameIndex]);
-                    }
+                        if (ImGui::IsItemHovered() && (ImGui::IsMouseReleased(ImGuiMouseButton_Left) || ImGui::IsMouseReleased(ImGuiMouseButton_Right)))
+                        {
+                            SelectFrame(_frames[frameIndex]);
+                        }
 
-                    if (std::string sideLabel = GetSideLabel(_frames[frameIndex]); sideLabel.length() > 0) 
-                    {
-                        ImGui::SameLine();
-                        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(color));
-                        ImGui::TextUnformatted(sideLabel.begin().base(), sideLabel.end().base());
+                        if (std::string sideLabel = GetSideLabel(_frames[frameIndex]); sideLabel.length() > 0) 
+                        {
+                            ImGui::SameLine();
+                            ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(color));
+                            ImGui::TextUnformatted(sideLabel.begin().base(), sideLabel.end().base());
+                            ImGui::PopStyleColor(1);
+                        }
+                        
                         ImGui::PopStyleColor(1);
-                    }
-                    
-                    ImGui::PopStyleColor(1);
 
-                    if (ImGui::IsItemVisible() && !IsTextureValid(_frames[frameIndex].texture)) 
-                    {
-                        _frames[frameIndex].texture = GetFrameTexture(filePath);
-                    }
+                        if (ImGui::IsItemVisible())
+                        {
+                            _visibleFiles.push_back(filePath);
+                            if (!IsTextureValid(_frames[frameIndex].texture)) 
+                            {
+                                _frames[frameIndex].texture = GetFrameTexture(filePath);
+                            }
+                        }
 
-                    ImGui::TextColored(color, "%s", _frames[frameIndex].label.c_str());
+                        ImGui::TextColored(color, "%s", _frames[frameIndex].label.c_str());
+                    }
                 }
             }
             ImGui::EndTable();
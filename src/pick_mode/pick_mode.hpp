@@ -28,13 +28,18 @@
 #include <string>
 #include <map>
 #include <set>
+#include <unordered_map>
 
 #include "../app.hpp"
 #include "../dialogs/dialogs.hpp"
+#include "thumbnail_cache.hpp"
+#include "asset_index.hpp"
 
 #define SEARCH_BUFFER_SIZE 256
 #define FRAME_SIZE 196
 #define ICON_SIZE 64
+#define ICON_UPLOADS_PER_FRAME 8 // Maximum number of icon textures sent to the GPU in one frame
+#define SHAPE_ICON_RENDERS_PER_FRAME 16 // Maximum number of shape icons drawn into their render textures in one frame
 
 class PickMode : public App::ModeImpl
 {
@@ -44,37 +49,50 @@ public:
     {
         fs::path        filePath;
         std::string     label;
+        std::string     lowerCaseLabel; // Used for searching
         Texture         texture;
 
         Frame();
         Frame(const fs::path filePath, const fs::path rootDir);
     };
 
-    PickMode(App::Settings &settings, int maxSelectionCount, std::string fileExtension);
+    PickMode(App::Settings &settings, AssetIndex &assetIndex, int maxSelectionCount, std::string fileExtension);
+    virtual ~PickMode() override;
     virtual void OnEnter() override;
     virtual void Update() override;
     virtual void Draw() override;
 protected:
+    // Returns the icon for the frame, or an invalid texture if it isn't ready yet (in which case this will be called again on a later frame).
+    // Implementations should decrement `_uploadBudget` whenever they upload a texture, and wait for a later frame once it reaches zero.
     virtual Texture GetFrameTexture(const fs::path& filePath) = 0;
     virtual void SelectFrame(const Frame frame) = 0;
     virtual bool IsFrameSelected(const fs::path& filePath) = 0;
     virtual std::string GetSideLabel(const Frame frame);
 
-    // Retrieves files, recursively, and generates frames for each.
-    
     App::Settings &_settings;
+    AssetIndex &_assetIndex;
     std::set<fs::path> _foundFiles;
-    std::vector<Frame> _frames;
+    std::vector<Frame> _frames; // One for every found file, kept between searches so that their icons stay loaded
+    std::vector<size_t> _filteredFrames; // Indices of the frames that match the search filter
     fs::path _rootDir;
     std::string _fileExtension;
     int _maxSelectionCount;
+    int _uploadBudget; // The number of icon textures that may still be uploaded during this frame
+    std::vector<fs::path> _visibleFiles; // Files whose frames were scrolled into view during the last draw
     
 private:
+    // Generates frames for each found file and indexes their labels for searching.
     void _GetFrames();
+    // Fills `_filteredFrames` with the frames whose labels contain the search filter.
+    void _FilterFrames();
 
     std::unique_ptr<Dialog> _activeDialog;
+    Texture _placeholderTexture; // Shown in place of icons that haven't loaded yet
     char _searchFilterBuffer[SEARCH_BUFFER_SIZE];
     char _searchFilterPrevious[SEARCH_BUFFER_SIZE];
+
+    // Maps every three character sequence that occurs in the lower case labels to the (sorted) indices of the frames containing it.
+    std::unordered_map<uint32_t, std::vector<size_t>> _trigramIndex;
 };
 
 class TexturePickMode : public PickMode
@@ -82,8 +100,9 @@ class TexturePickMode : public PickMode
 public:
     using TexSelection = std::array<std::shared_ptr<Assets::TexHandle>, TEXTURES_PER_TILE>;
 
-    TexturePickMode(App::Settings &settings);
+    TexturePickMode(App::Settings &settings, AssetIndex &assetIndex);
     virtual void OnEnter() override;
+    virtual void Update() override;
     virtual void OnExit() override;
 
     TexSelection GetPickedTextures() const;
@@ -95,6 +114,8 @@ protected:
     virtual std::string GetSideLabel(const Frame frame) override;
 
     std::map<fs::path, Texture2D> _loadedTextures;
+    // Scaled down copies of the textures that persist between sessions.
+    ThumbnailCache _thumbnails;
     // The first one is the primary texture and the second one is the secondary texture.
     TexSelection _selectedTextures;
 };
@@ -102,7 +123,7 @@ protected:
 class ShapePickMode : public PickMode
 {
 public:
-    ShapePickMode(App::Settings &settings);
+    ShapePickMode(App::Settings &settings, AssetIndex &assetIndex);
     virtual void OnEnter() override;
     virtual void Update() override;
     virtual void OnExit() override;
@@ -114,16 +135,21 @@ protected:
     virtual void SelectFrame(const Frame frame) override;
     virtual bool IsFrameSelected(const fs::path& filePath) override;
     
-    // Load or retrieve cached model
+    struct ShapeIcon
+    {
+        RenderTexture2D target;
+        bool rendered; // False until the shape has been drawn into the texture at least once
+    };
+
+    // Retrieve model from the asset cache, keeping it loaded while the picker is open
     Model _GetModel(const fs::path path);
-    // Load or retrieve cached render texture
-    RenderTexture2D _GetShapeIcon(const fs::path path);
 
     Camera _iconCamera; // Camera for rendering 3D shape preview icons
+    size_t _iconRenderOffset; // Rotates which visible icons get re-rendered when there are more than can be drawn in one frame
 
     std::shared_ptr<Assets::ModelHandle> _selectedShape;
-    std::map<fs::path, Model> _loadedModels;
-    std::map<fs::path, RenderTexture2D> _loadedIcons;
+    std::map<fs::path, std::shared_ptr<Assets::ModelHandle>> _loadedModels;
+    std::map<fs::path, ShapeIcon> _loadedIcons;
 };
 
 #endif
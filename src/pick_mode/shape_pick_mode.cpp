@@ -20,8 +20,9 @@
 
 #include "pick_mode.hpp"
 
-ShapePickMode::ShapePickMode(App::Settings& settings)
-    : PickMode(settings, 1, ".obj")
+ShapePickMode::ShapePickMode(App::Settings& settings, AssetIndex& assetIndex)
+    : PickMode(settings, assetIndex, 1, ".obj"),
+      _iconRenderOffset(0)
 {
     _iconCamera = Camera {
         .position = Vector3 { 4.0f, 4.0f, 4.0f },
@@ -41,34 +42,48 @@ void ShapePickMode::OnEnter()
 
 void ShapePickMode::Update()
 {
-    for (const Frame& frame : _frames) 
+    // Update/redraw the shape preview icons so that they spin.
+    // This has to be done before the main application renders or it won't work.
+    // Only the icons that were visible last frame are drawn, and no more than SHAPE_ICON_RENDERS_PER_FRAME of them.
+    const size_t visibleCount = _visibleFiles.size();
+    int renderCount = 0;
+    for (size_t v = 0; v < visibleCount && renderCount < SHAPE_ICON_RENDERS_PER_FRAME; ++v)
     {
-        // Update/redraw the shape preview icons so that they spin.
-        // This has to be done before the main application renders or it won't work.
-        BeginTextureMode(_GetShapeIcon(frame.filePath));
+        const fs::path& filePath = _visibleFiles[(v + _iconRenderOffset) % visibleCount];
+        auto iconIter = _loadedIcons.find(filePath);
+        if (iconIter == _loadedIcons.end()) continue;
+
+        // Static icons never need to be redrawn.
+        ShapeIcon& icon = iconIter->second;
+        if (icon.rendered && !_settings.animateShapeIcons) continue;
+
+        float angle = _settings.animateShapeIcons ? float(GetTime() * 180.0f) : 0.0f;
+
+        BeginTextureMode(icon.target);
         ClearBackground(BLACK);
         BeginMode3D(_iconCamera);
 
-        DrawModelWiresEx(_GetModel(frame.filePath), Vector3Zero(), Vector3{0.0f, 1.0f, 0.0f}, float(GetTime() * 180.0f), Vector3One(), GREEN);
+        DrawModelWiresEx(_GetModel(filePath), Vector3Zero(), Vector3{0.0f, 1.0f, 0.0f}, angle, Vector3One(), GREEN);
 
         EndMode3D();
         EndTextureMode();
+
+        icon.rendered = true;
+        ++renderCount;
     }
+    if (visibleCount > 0) _iconRenderOffset = (_iconRenderOffset + renderCount) % visibleCount;
 
     PickMode::Update();
 }
 
 void ShapePickMode::OnExit()
 {
-    for (const auto& pair : _loadedModels)
-    {
-        UnloadModel(pair.second);
-    }
+    // Releases this mode's references to the models; they stay loaded in the asset cache only if used elsewhere.
     _loadedModels.clear();
 
     for (const auto& pair : _loadedIcons)
     {
-        UnloadRenderTexture(pair.second);
+        UnloadRenderTexture(pair.second.target);
     }
     _loadedIcons.clear();
 }
@@ -85,7 +100,23 @@ void ShapePickMode::SetPickedShape(std::shared_ptr<Assets::ModelHandle> newModel
 
 Texture ShapePickMode::GetFrameTexture(const fs::path& filePath)
 {
-    return _GetShapeIcon(filePath).texture;
+    auto iconIter = _loadedIcons.find(filePath);
+    if (iconIter == _loadedIcons.end())
+    {
+        if (_uploadBudget <= 0) return Texture { 0 };
+        --_uploadBudget;
+
+        // The icon will be drawn during the next update.
+        _loadedIcons[filePath] = ShapeIcon { 
+            .target = LoadRenderTexture(ICON_SIZE, ICON_SIZE), 
+            .rendered = false 
+        };
+        return Texture { 0 };
+    }
+
+    // Show the placeholder until the icon has something in it.
+    if (!iconIter->second.rendered) return Texture { 0 };
+    return iconIter->second.target.texture;
 }
 
 void ShapePickMode::SelectFrame(const Frame frame)
@@ -102,20 +133,9 @@ Model ShapePickMode::_GetModel(const fs::path path)
 {
     if (_loadedModels.find(path) == _loadedModels.end())
     {
-        Model model = LoadModel(path.string().c_str());
-        _loadedModels[path] = model;
-        return model;
+        _loadedModels[path] = Assets::GetModel(path);
     }
-    return _loadedModels[path];
+    
+    const std::shared_ptr<Assets::ModelHandle>& handle = _loadedModels[path];
+    return handle != nullptr ? handle->GetModel() : Model {};
 }
-
-RenderTexture2D ShapePickMode::_GetShapeIcon(const fs::path path)
-{
-    if (_loadedIcons.find(path) == _loadedIcons.end())
-    {
-        RenderTexture2D icon = LoadRenderTexture(ICON_SIZE, ICON_SIZE);
-        _loadedIcons[path] = icon;
-        return icon;
-    }
-    return _loadedIcons[path];
-}
\ No newline at end of file
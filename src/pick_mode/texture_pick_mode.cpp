@@ -20,18 +20,28 @@
 
 #include "pick_mode.hpp"
 
-TexturePickMode::TexturePickMode(App::Settings& settings)
-    : PickMode(settings, 2, ".png")
+#include "../assets.hpp"
+
+TexturePickMode::TexturePickMode(App::Settings& settings, AssetIndex& assetIndex)
+    : PickMode(settings, assetIndex, 2, ".png"),
+      _thumbnails(THUMBNAIL_CACHE_FILE_PATH, ICON_SIZE)
 {
 }
 
 void TexturePickMode::OnEnter()
 {
     _rootDir = fs::path(App::Get()->GetTexturesDir());
+    _thumbnails.Load();
 
     PickMode::OnEnter();
 }
 
+void TexturePickMode::Update()
+{
+    _thumbnails.BeginFrame();
+    PickMode::Update();
+}
+
 void TexturePickMode::OnExit()
 {
     for (const auto& pair : _loadedTextures)
@@ -39,6 +49,7 @@ void TexturePickMode::OnExit()
         UnloadTexture(pair.second);
     }
     _loadedTextures.clear();
+    _thumbnails.Save();
 }
 
 TexturePickMode::TexSelection TexturePickMode::GetPickedTextures() const
@@ -53,13 +64,40 @@ void TexturePickMode::SetPickedTextures(TexturePickMode::TexSelection newTexture
 
 Texture TexturePickMode::GetFrameTexture(const fs::path& filePath)
 {
-    if (_loadedTextures.find(filePath) == _loadedTextures.end())
+    if (_loadedTextures.find(filePath) != _loadedTextures.end())
+    {
+        return _loadedTextures[filePath];
+    }
+
+    // Thumbnails are generated in the background, so the frame will show a placeholder until it's ready.
+    ThumbnailCache::Status status = _thumbnails.RequestThumbnail(filePath);
+    if (status == ThumbnailCache::Status::PENDING || _uploadBudget <= 0)
     {
-        Texture2D tex = LoadTexture(filePath.string().c_str());
-        _loadedTextures[filePath] = tex;
-        return tex;
+        return Texture { 0 };
     }
-    return _loadedTextures[filePath];
+    --_uploadBudget;
+
+    // Only the icon-sized thumbnail is uploaded, instead of the full resolution image.
+    std::vector<uint8_t> pixels;
+    Texture2D tex;
+    if (status == ThumbnailCache::Status::READY && _thumbnails.CopyThumbnail(filePath, pixels))
+    {
+        Image image = Image {
+            .data = pixels.data(),
+            .width = ICON_SIZE,
+            .height = ICON_SIZE,
+            .mipmaps = 1,
+            .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+        };
+        tex = LoadTextureFromImage(image);
+    }
+    else
+    {
+        tex = Assets::GetMissingTexture();
+    }
+
+    _loadedTextures[filePath] = tex;
+    return tex;
 }
 
 void TexturePickMode::SelectFrame(const Frame frame)
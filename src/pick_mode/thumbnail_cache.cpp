@@ -0,0 +1,286 @@
+/**
+ * Copyright (c) 2022-present Alexander Lunsford
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#include "thumbnail_cache.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+#include "../math_stuff.hpp"
+
+#define THUMBNAIL_CACHE_MAGIC 0x54334554U // "TE3T"
+#define THUMBNAIL_CACHE_VERSION 2U // Version 1 thumbnails were scaled with nearest neighbor sampling
+#define THUMBNAIL_WORKERS_MAX 4
+
+template<typename T>
+static void WriteValue(std::ofstream& file, T value)
+{
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Copies a value out of `bytes` and advances `offset`. Returns false if there aren't enough bytes left.
+template<typename T>
+static bool ReadValue(const std::vector<char>& bytes, size_t& offset, T& outValue)
+{
+    if (offset + sizeof(T) > bytes.size()) return false;
+    memcpy(&outValue, &bytes[offset], sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+ThumbnailCache::ThumbnailCache(fs::path cacheFilePath, int thumbnailSize)
+    : _cacheFilePath(cacheFilePath),
+      _thumbnailSize(thumbnailSize),
+      _loaded(false),
+      _dirty(false),
+      _frame(0),
+      _stopWorkers(false)
+{
+    // Leave one core for the main thread.
+    int workerCount = Min(Max((int)std::thread::hardware_concurrency() - 1, 1), THUMBNAIL_WORKERS_MAX);
+    for (int w = 0; w < workerCount; ++w)
+    {
+        _workers.emplace_back(&ThumbnailCache::_WorkerLoop, this);
+    }
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopWorkers = true;
+    }
+    _wakeWorkers.notify_all();
+    for (std::thread& worker : _workers)
+    {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+bool ThumbnailCache::_GetFileStamp(const fs::path& path, int64_t& outModifiedTime, uint64_t& outFileSize)
+{
+    std::error_code err;
+    fs::file_time_type modifiedTime = fs::last_write_time(path, err);
+    if (err) return false;
+    uintmax_t fileSize = fs::file_size(path, err);
+    if (err) return false;
+
+    outModifiedTime = (int64_t)modifiedTime.time_since_epoch().count();
+    outFileSize = (uint64_t)fileSize;
+    return true;
+}
+
+void ThumbnailCache::Load()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_loaded) return;
+    _loaded = true;
+
+    // The whole file is read at once and then parsed from memory.
+    std::ifstream file(_cacheFilePath, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return;
+    std::streamsize fileSize = file.tellg();
+    if (fileSize <= 0) return;
+    std::vector<char> bytes((size_t)fileSize);
+    file.seekg(0);
+    if (!file.read(bytes.data(), fileSize)) return;
+
+    size_t offset = 0;
+    uint32_t magic = 0, version = 0, entryCount = 0;
+    if (!ReadValue(bytes, offset, magic) || magic != THUMBNAIL_CACHE_MAGIC 
+        || !ReadValue(bytes, offset, version) || version != THUMBNAIL_CACHE_VERSION
+        || !ReadValue(bytes, offset, entryCount))
+    {
+        std::cerr << "Thumbnail cache at " << _cacheFilePath << " is invalid and will be rebuilt." << std::endl;
+        return;
+    }
+
+    const size_t pixelsSize = (size_t)_thumbnailSize * (size_t)_thumbnailSize * 4;
+    for (uint32_t e = 0; e < entryCount; ++e)
+    {
+        uint16_t pathLength = 0;
+        Entry entry;
+        uint8_t hasPixels = 0;
+        if (!ReadValue(bytes, offset, pathLength) || offset + pathLength > bytes.size()) break;
+        std::string path(&bytes[offset], pathLength);
+        offset += pathLength;
+        if (!ReadValue(bytes, offset, entry.modifiedTime) 
+            || !ReadValue(bytes, offset, entry.fileSize)
+            || !ReadValue(bytes, offset, hasPixels)) break;
+        if (hasPixels)
+        {
+            if (offset + pixelsSize > bytes.size()) break;
+            entry.pixels.assign(bytes.begin() + offset, bytes.begin() + offset + pixelsSize);
+            offset += pixelsSize;
+        }
+        entry.verified = false;
+        _entries[path] = std::move(entry);
+    }
+}
+
+void ThumbnailCache::Save()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_dirty) return;
+
+    std::ofstream file(_cacheFilePath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not write thumbnail cache to " << _cacheFilePath << std::endl;
+        return;
+    }
+
+    // Drop entries for files that have been deleted so that the cache doesn't grow forever.
+    for (auto iter = _entries.begin(); iter != _entries.end();)
+    {
+        std::error_code err;
+        if (!fs::exists(fs::path(iter->first), err)) iter = _entries.erase(iter);
+        else ++iter;
+    }
+
+    WriteValue<uint32_t>(file, THUMBNAIL_CACHE_MAGIC);
+    WriteValue<uint32_t>(file, THUMBNAIL_CACHE_VERSION);
+    WriteValue<uint32_t>(file, (uint32_t)_entries.size());
+    for (const auto& [path, entry] : _entries)
+    {
+        WriteValue<uint16_t>(file, (uint16_t)path.size());
+        file.write(path.data(), path.size());
+        WriteValue<int64_t>(file, entry.modifiedTime);
+        WriteValue<uint64_t>(file, entry.fileSize);
+        WriteValue<uint8_t>(file, entry.pixels.empty() ? 0 : 1);
+        file.write(reinterpret_cast<const char*>(entry.pixels.data()), entry.pixels.size());
+    }
+
+    if (file.fail())
+    {
+        std::cerr << "Error writing thumbnail cache to " << _cacheFilePath << std::endl;
+        return;
+    }
+    _dirty = false;
+}
+
+void ThumbnailCache::BeginFrame()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_frame;
+}
+
+ThumbnailCache::Status ThumbnailCache::RequestThumbnail(const fs::path& path)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::string key = path.generic_string();
+
+    if (_inProgress.find(key) != _inProgress.end()) return Status::PENDING;
+
+    auto iter = _entries.find(key);
+    if (iter != _entries.end() && !iter->second.verified)
+    {
+        // Make sure the file hasn't changed since the thumbnail was made.
+        int64_t modifiedTime;
+        uint64_t fileSize;
+        if (_GetFileStamp(path, modifiedTime, fileSize) 
+            && modifiedTime == iter->second.modifiedTime && fileSize == iter->second.fileSize)
+        {
+            iter->second.verified = true;
+        }
+        else
+        {
+            _entries.erase(iter);
+            iter = _entries.end();
+        }
+    }
+
+    if (iter == _entries.end())
+    {
+        // Adds the request, or moves it to the front of the queue if it's already there.
+        _requests[key] = _frame;
+        _wakeWorkers.notify_one();
+        return Status::PENDING;
+    }
+
+    return iter->second.pixels.empty() ? Status::FAILED : Status::READY;
+}
+
+bool ThumbnailCache::CopyThumbnail(const fs::path& path, std::vector<uint8_t>& outPixels)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto iter = _entries.find(path.generic_string());
+    if (iter == _entries.end() || iter->second.pixels.empty()) return false;
+    outPixels = iter->second.pixels;
+    return true;
+}
+
+void ThumbnailCache::_WorkerLoop()
+{
+    while (true)
+    {
+        std::string key;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeWorkers.wait(lock, [this]{ return _stopWorkers || !_requests.empty(); });
+            if (_stopWorkers) return;
+
+            // Take the most recently requested file, since that's the one most likely to be on screen.
+            // Files that haven't been requested lately have scrolled out of view, so they are forgotten.
+            auto newest = _requests.end();
+            for (auto iter = _requests.begin(); iter != _requests.end();)
+            {
+                if (iter->second + REQUEST_EXPIRATION_FRAMES < _frame)
+                {
+                    iter = _requests.erase(iter);
+                    continue;
+                }
+                if (newest == _requests.end() || iter->second > newest->second) newest = iter;
+                ++iter;
+            }
+            if (newest == _requests.end()) continue;
+
+            key = newest->first;
+            _requests.erase(newest);
+            _inProgress.insert(key);
+        }
+
+        const fs::path path(key);
+        Entry entry;
+        entry.verified = true;
+        entry.modifiedTime = 0;
+        entry.fileSize = 0;
+        _GetFileStamp(path, entry.modifiedTime, entry.fileSize);
+
+        // Image decoding doesn't touch the GPU, so it's safe to do here.
+        Image image = LoadImage(path.string().c_str());
+        if (IsImageValid(image))
+        {
+            ImageFormat(&image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+            ImageResize(&image, _thumbnailSize, _thumbnailSize);
+            const uint8_t* data = (const uint8_t*)image.data;
+            entry.pixels.assign(data, data + (size_t)_thumbnailSize * (size_t)_thumbnailSize * 4);
+        }
+        UnloadImage(image);
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _entries[key] = std::move(entry);
+            _inProgress.erase(key);
+            _dirty = true;
+        }
+    }
+}
@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2022-present Alexander Lunsford
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include "raylib.h"
+
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#define THUMBNAIL_CACHE_FILE_PATH "te3_thumbnails.bin"
+
+// Stores small, pre-scaled preview images for the asset pickers in a single packed file.
+// Entries are keyed by the asset's path, modification time, and size, so edited assets get new thumbnails.
+// Missing or outdated thumbnails are generated on background threads, most recently requested first.
+class ThumbnailCache
+{
+public:
+    enum class Status { READY, PENDING, FAILED };
+
+    // `thumbnailSize` is the width and height, in pixels, of every stored thumbnail.
+    ThumbnailCache(fs::path cacheFilePath, int thumbnailSize);
+    ~ThumbnailCache();
+
+    // Reads all of the thumbnails from the cache file. Does nothing after the first call.
+    void Load();
+    // Writes the thumbnails back into the cache file if any of them have changed.
+    void Save();
+
+    // Marks the start of a new UI frame. Requests that aren't repeated within a couple of frames are dropped.
+    void BeginFrame();
+
+    // Returns READY if an up to date thumbnail exists for the file at `path`.
+    // Otherwise, the thumbnail is queued for generation and PENDING is returned.
+    // Calling this every frame for visible items keeps their requests at the front of the queue.
+    // FAILED is returned if the file could not be loaded as an image.
+    Status RequestThumbnail(const fs::path& path);
+
+    // Copies the RGBA pixels of a READY thumbnail into `outPixels`. Returns false if there is no such thumbnail.
+    bool CopyThumbnail(const fs::path& path, std::vector<uint8_t>& outPixels);
+protected:
+    struct Entry
+    {
+        int64_t modifiedTime;
+        uint64_t fileSize;
+        std::vector<uint8_t> pixels; // Empty if the image failed to load.
+        bool verified; // True once the entry has been compared against the file on disk this session.
+    };
+
+    // Returns false if the file's metadata couldn't be retrieved.
+    static bool _GetFileStamp(const fs::path& path, int64_t& outModifiedTime, uint64_t& outFileSize);
+
+    void _WorkerLoop();
+
+    // Requests that haven't been repeated for this many frames are dropped from the queue.
+    static const uint64_t REQUEST_EXPIRATION_FRAMES = 2;
+
+    fs::path _cacheFilePath;
+    int _thumbnailSize;
+    bool _loaded;
+    bool _dirty;
+
+    std::map<std::string, Entry> _entries; // Keyed by generic path string
+    std::map<std::string, uint64_t> _requests; // Files waiting for generation, with the frame they were last requested on
+    std::set<std::string> _inProgress; // Files being generated right now
+    uint64_t _frame;
+
+    std::mutex _mutex;
+    std::condition_variable _wakeWorkers;
+    std::vector<std::thread> _workers;
+    bool _stopWorkers;
+};
+
+#endif
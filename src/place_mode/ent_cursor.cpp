@@ -77,5 +77,6 @@ void PlaceMode::EntCursor::Update(MapMan& mapMan, size_t i, size_t j, size_t k,
 
 void PlaceMode::EntCursor::Draw()
 {
+    ent.lastRenderedPosition = position;
     ent.Draw(true, position);
 }
\ No newline at end of file
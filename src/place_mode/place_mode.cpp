@@ -47,6 +47,7 @@ PlaceMode::PlaceMode(MapMan &mapMan)
 
     _cursor = &_tileCursor;
     _cursor->position = _tileCursor.endPosition = Vector3Zero();
+    _cursorPick = CursorPick::PLANE;
     _outlineScale = 1.125f;
 
     ResetCamera();
@@ -212,22 +213,57 @@ void PlaceMode::UpdateCursor()
         _cursor = &_entCursor;
     }
 
+    // Press P to switch between picking on the editing plane and on the surfaces of tiles.
+    if (IsKeyPressed(KEY_P))
+    {
+        static const char* PICK_MESSAGES[] = { "CURSOR: EDITING PLANE", "CURSOR: IN FRONT OF SURFACES", "CURSOR: ON SURFACES" };
+        _cursorPick = (CursorPick)(((int)_cursorPick + 1) % 3);
+        App::Get()->DisplayStatusMessage(PICK_MESSAGES[(int)_cursorPick], 2.0f, 3);
+    }
+
     // Position cursor
     Vector2 currentMousePosition = GetMousePosition();
     if (Vector2LengthSqr(currentMousePosition - _previousMousePosition) > 1.0f) 
     {
         Ray pickRay = GetMouseRay(currentMousePosition, _camera);
-        Vector3 gridMin = _mapMan.Tiles().GetMinCorner();
-        Vector3 gridMax = _mapMan.Tiles().GetMaxCorner();
-        RayCollision col = GetRayCollisionQuad(pickRay, 
-            Vector3{ gridMin.x, _planeWorldPos.y, gridMin.z }, 
-            Vector3{ gridMax.x, _planeWorldPos.y, gridMin.z }, 
-            Vector3{ gridMax.x, _planeWorldPos.y, gridMax.z }, 
-            Vector3{ gridMin.x, _planeWorldPos.y, gridMax.z });
-        if (col.hit)
+
+        // When the mouse is over a tile, the surface picking modes use it instead of the plane.
+        TileRayHit tileHit = { 0 };
+        if (_cursorPick != CursorPick::PLANE)
         {
-            _cursor->position = _mapMan.Tiles().SnapToCelCenter(col.point);
-            _cursor->position.y = _planeWorldPos.y + _mapMan.Tiles().GetSpacing() / 2.0f;
+            tileHit = _mapMan.Tiles().Raycast(pickRay, _layerViewMin, _layerViewMax, true);
+        }
+
+        if (tileHit.hit)
+        {
+            Vector3 celPos = Vector3 { (float)tileHit.i, (float)tileHit.j, (float)tileHit.k };
+            if (_cursorPick == CursorPick::SURFACE) celPos = celPos + tileHit.side;
+
+            // The cel in front has to be in the grid and on a visible layer. It doesn't exist if the ray started inside the tile.
+            bool inFront = (_cursorPick != CursorPick::SURFACE) || Vector3LengthSqr(tileHit.side) > 0.0f;
+            if (inFront && celPos.x >= 0.0f && celPos.z >= 0.0f && celPos.x < _mapMan.Tiles().GetWidth() && celPos.z < _mapMan.Tiles().GetLength()
+                && celPos.y >= _layerViewMin && celPos.y <= _layerViewMax)
+            {
+                _cursor->position = _mapMan.Tiles().GridToWorldPos(celPos, true);
+                // Move the editing plane to the cursor, so that it stays on that layer when the mouse stops.
+                _planeGridPos.y = celPos.y;
+                _planeWorldPos = _mapMan.Tiles().GridToWorldPos(_planeGridPos, false);
+            }
+        }
+        else
+        {
+            Vector3 gridMin = _mapMan.Tiles().GetMinCorner();
+            Vector3 gridMax = _mapMan.Tiles().GetMaxCorner();
+            RayCollision col = GetRayCollisionQuad(pickRay, 
+                Vector3{ gridMin.x, _planeWorldPos.y, gridMin.z }, 
+                Vector3{ gridMax.x, _planeWorldPos.y, gridMin.z }, 
+                Vector3{ gridMax.x, _planeWorldPos.y, gridMax.z }, 
+                Vector3{ gridMin.x, _planeWorldPos.y, gridMax.z });
+            if (col.hit)
+            {
+                _cursor->position = _mapMan.Tiles().SnapToCelCenter(col.point);
+                _cursor->position.y = _planeWorldPos.y + _mapMan.Tiles().GetSpacing() / 2.0f;
+            }
         }
     }
     else 
@@ -265,6 +301,71 @@ void PlaceMode::UpdateCursor()
         _brushCursor.endPosition = _tileCursor.endPosition;
     }
 
+    // Press LEFT CTRL+F to fill the tiles connected to the one under the cursor with the cursor's tile.
+    // Hold LEFT ALT too to connect tiles diagonally. Hidden layers are left alone.
+    if (_cursor == &_tileCursor && IsKeyPressed(KEY_F) && IsKeyDown(KEY_LEFT_CONTROL))
+    {
+        Tile fillTile;
+        if (_tileCursor.MakeTile(_mapMan, fillTile))
+        {
+            size_t filled = _mapMan.ExecuteFloodFill(i, j, k, fillTile, IsKeyDown(KEY_LEFT_ALT), _layerViewMin, _layerViewMax);
+            App::Get()->DisplayStatusMessage("Filled " + std::to_string(filled) + " tiles.", 2.0f, 3);
+        }
+    }
+
+    // While selecting with LEFT SHIFT, press [ or ] to rotate the selected tiles, M, N, or U to mirror them along the X, Z, or Y axis,
+    // and the arrow keys or PAGE UP/PAGE DOWN to move them. The selection follows the tiles.
+    if (_cursor == &_tileCursor && IsKeyDown(KEY_LEFT_SHIFT))
+    {
+        int newI = i, newJ = j, newK = k, newW = w, newH = h, newL = l;
+        bool changed = false;
+        if (IsKeyPressed(KEY_LEFT_BRACKET)) changed = _mapMan.ExecuteTileTransform(newI, newJ, newK, newW, newH, newL, TileTransform::ROTATE_CCW);
+        else if (IsKeyPressed(KEY_RIGHT_BRACKET)) changed = _mapMan.ExecuteTileTransform(newI, newJ, newK, newW, newH, newL, TileTransform::ROTATE_CW);
+        else if (IsKeyPressed(KEY_M)) changed = _mapMan.ExecuteTileTransform(newI, newJ, newK, newW, newH, newL, TileTransform::MIRROR_X);
+        else if (IsKeyPressed(KEY_N)) changed = _mapMan.ExecuteTileTransform(newI, newJ, newK, newW, newH, newL, TileTransform::MIRROR_Z);
+        else if (IsKeyPressed(KEY_U)) changed = _mapMan.ExecuteTileTransform(newI, newJ, newK, newW, newH, newL, TileTransform::MIRROR_Y);
+        else
+        {
+            int dx = (IsKeyPressed(KEY_RIGHT) || IsKeyPressedRepeat(KEY_RIGHT)) - (IsKeyPressed(KEY_LEFT) || IsKeyPressedRepeat(KEY_LEFT));
+            int dz = (IsKeyPressed(KEY_DOWN) || IsKeyPressedRepeat(KEY_DOWN)) - (IsKeyPressed(KEY_UP) || IsKeyPressedRepeat(KEY_UP));
+            int dy = IsKeyPressed(KEY_PAGE_UP) - IsKeyPressed(KEY_PAGE_DOWN);
+            if (dx != 0 || dy != 0 || dz != 0)
+            {
+                changed = _mapMan.ExecuteTileMove(newI, newJ, newK, newW, newH, newL, dx, dy, dz);
+            }
+        }
+
+        if (changed)
+        {
+            // Each end of the cursor stays on the same side of the selection that it was on before.
+            Vector3 newMin = Vector3 { (float)newI, (float)newJ, (float)newK };
+            Vector3 newMax = Vector3 { float(newI + newW - 1), float(newJ + newH - 1), float(newK + newL - 1) };
+            Vector3 newStart = Vector3 {
+                cursorStartGridPos.x <= cursorEndGridPos.x ? newMin.x : newMax.x,
+                cursorStartGridPos.y <= cursorEndGridPos.y ? newMin.y : newMax.y,
+                cursorStartGridPos.z <= cursorEndGridPos.z ? newMin.z : newMax.z,
+            };
+            Vector3 newEnd = Vector3 {
+                cursorStartGridPos.x <= cursorEndGridPos.x ? newMax.x : newMin.x,
+                cursorStartGridPos.y <= cursorEndGridPos.y ? newMax.y : newMin.y,
+                cursorStartGridPos.z <= cursorEndGridPos.z ? newMax.z : newMin.z,
+            };
+            _tileCursor.position = _mapMan.Tiles().GridToWorldPos(newStart, true);
+            _tileCursor.endPosition = _mapMan.Tiles().GridToWorldPos(newEnd, true);
+
+            // The editing plane follows the cursor, since it sets the cursor's height.
+            _planeGridPos.y = newStart.y;
+            _planeWorldPos = _mapMan.Tiles().GridToWorldPos(_planeGridPos, false);
+
+            i = newI;
+            j = newJ;
+            k = newK;
+            w = newW;
+            h = newH;
+            l = newL;
+        }
+    }
+
     _cursor->Update(_mapMan, i, j, k, w, h, l);
 }
 
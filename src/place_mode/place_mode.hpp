@@ -73,6 +73,9 @@ protected:
 
         TileCursor();
         ~TileCursor();
+        // Makes the tile that the cursor places, adding its shape and textures to the map if needed.
+        // Returns false, showing an error, if the map has no room for more shapes or textures.
+        bool MakeTile(MapMan& mapMan, Tile& tile) const;
         void Update(MapMan& mapMan, size_t i, size_t j, size_t k, size_t w, size_t h, size_t l) override;
         void Draw() override;
     };
@@ -95,6 +98,14 @@ protected:
         void Draw() override;
     };
 
+    // Ways of positioning the cursor with the mouse.
+    enum class CursorPick
+    {
+        PLANE,        // On the editing plane
+        SURFACE,      // In the empty cel in front of the tile under the mouse
+        SURFACE_TILE  // On the tile under the mouse
+    };
+
     void MoveCamera();
     void UpdateCursor();
 
@@ -110,6 +121,7 @@ protected:
     EntCursor _entCursor;
     Cursor* _cursor; // The current cursor being used in the editor. Will point to one of: _tileCursor, _brushCursor, _entCursor
     Vector3 _cursorPreviousGridPos;
+    CursorPick _cursorPick;
     Vector2 _previousMousePosition;
 
     float _outlineScale; // How much the wire box around the cursor is larger than its contents
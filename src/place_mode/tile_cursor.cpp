@@ -21,6 +21,7 @@
 #include "place_mode.hpp"
 
 #include "../assets.hpp"
+#include "../app.hpp"
 #include "../math_stuff.hpp"
 
 PlaceMode::TileCursor::TileCursor() 
@@ -45,6 +46,23 @@ PlaceMode::TileCursor::~TileCursor()
     }
 }
 
+bool PlaceMode::TileCursor::MakeTile(MapMan& mapMan, Tile& tile) const
+{
+    tile = Tile(
+        mapMan.GetOrAddModelID(model->GetPath()),
+        mapMan.GetOrAddTexID(textures[0]->GetPath()),
+        mapMan.GetOrAddTexID(textures[1]->GetPath()),
+        yaw,
+        pitch
+    );
+    if (tile.shape == NO_MODEL || tile.textures[0] == NO_TEX || tile.textures[1] == NO_TEX)
+    {
+        App::Get()->DisplayStatusMessage("ERROR: The map has too many shapes or textures to add this tile.", 5.0f, 100);
+        return false;
+    }
+    return true;
+}
+
 void PlaceMode::TileCursor::Update(MapMan& mapMan, size_t i, size_t j, size_t k, size_t w, size_t h, size_t l)
 {
     bool multiSelect = IsKeyDown(KEY_LEFT_SHIFT);
@@ -64,7 +82,7 @@ void PlaceMode::TileCursor::Update(MapMan& mapMan, size_t i, size_t j, size_t k,
     {
         yaw = (yaw + 1) % 4;
     }
-    if (IsKeyPressed(KEY_F))
+    if (!IsKeyDown(KEY_LEFT_CONTROL) && IsKeyPressed(KEY_F))
     {
         pitch = (pitch + 1) % 4;
     }
@@ -78,18 +96,11 @@ void PlaceMode::TileCursor::Update(MapMan& mapMan, size_t i, size_t j, size_t k,
         yaw = pitch = 0;
     }
 
-    Tile cursorTile = Tile(
-        mapMan.GetOrAddModelID(model->GetPath()),
-        mapMan.GetOrAddTexID(textures[0]->GetPath()),
-        mapMan.GetOrAddTexID(textures[1]->GetPath()),
-        yaw,
-        pitch
-    );
-
+    Tile cursorTile;
     if (IsMouseButtonDown(MOUSE_BUTTON_LEFT) && !IsKeyDown(KEY_LEFT_ALT) && !multiSelect) 
     {
         // Place tiles
-        if (underTile != cursorTile)
+        if (MakeTile(mapMan, cursorTile) && underTile != cursorTile)
         {
             mapMan.ExecuteTileAction(i, j, k, 1, 1, 1, cursorTile);
         }
@@ -97,7 +108,10 @@ void PlaceMode::TileCursor::Update(MapMan& mapMan, size_t i, size_t j, size_t k,
     else if (IsMouseButtonReleased(MOUSE_BUTTON_LEFT) && multiSelect)
     {
         // Place tiles rectangle
-        mapMan.ExecuteTileAction(i, j, k, w, h, l, cursorTile);
+        if (MakeTile(mapMan, cursorTile))
+        {
+            mapMan.ExecuteTileAction(i, j, k, w, h, l, cursorTile);
+        }
     }
     else if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT) && !multiSelect && underTile) 
     {
@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) 2022-present Alexander Lunsford
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#include "texture_atlas.hpp"
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <numeric>
+
+#include "math_stuff.hpp"
+
+static int NextPowerOfTwo(int value)
+{
+    int power = 1;
+    while (power < value) power *= 2;
+    return power;
+}
+
+std::vector<Image> PackTextureAtlas(const std::vector<Image>& images, int gutter, int maxSize, std::vector<AtlasRegion>& outRegions)
+{
+    // Where each image's gutter starts, in pixels
+    struct Placement
+    {
+        int page, x, y;
+    };
+    std::vector<Placement> placements(images.size());
+    std::vector<std::pair<int, int>> pageSizes;
+
+    // Place the tallest images first, on shelves that go from the top of the page to the bottom.
+    std::vector<size_t> order(images.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){ 
+        return (images[a].height != images[b].height) ? images[a].height > images[b].height : images[a].width > images[b].width; 
+    });
+
+    // Keep the pages close to square by limiting the width of the shelves to what the images would need if they were.
+    int64_t totalArea = 0;
+    int widest = 0;
+    for (const Image& image : images)
+    {
+        totalArea += (int64_t)(image.width + gutter * 2) * (image.height + gutter * 2);
+        widest = Max(widest, image.width + gutter * 2);
+    }
+    int shelfWidth = Min(maxSize, Max(widest, NextPowerOfTwo((int)ceil(sqrt((double)totalArea)))));
+
+    int shelfX = 0, shelfY = 0, shelfHeight = 0;
+    for (size_t i : order)
+    {
+        int width = images[i].width + gutter * 2;
+        int height = images[i].height + gutter * 2;
+
+        if (!pageSizes.empty() && shelfX + width > shelfWidth)
+        {
+            shelfX = 0;
+            shelfY += shelfHeight;
+            shelfHeight = 0;
+        }
+        if (pageSizes.empty() || shelfY + height > maxSize || shelfX + width > shelfWidth)
+        {
+            pageSizes.push_back(std::make_pair(0, 0));
+            shelfX = 0;
+            shelfY = 0;
+            shelfHeight = 0;
+        }
+
+        placements[i] = Placement { (int)pageSizes.size() - 1, shelfX, shelfY };
+        shelfX += width;
+        shelfHeight = Max(shelfHeight, height);
+        pageSizes.back().first = Max(pageSizes.back().first, shelfX);
+        pageSizes.back().second = Max(pageSizes.back().second, shelfY + height);
+    }
+
+    std::vector<Image> pages;
+    for (const auto& [width, height] : pageSizes)
+    {
+        pages.push_back(GenImageColor(NextPowerOfTwo(width), NextPowerOfTwo(height), BLANK));
+    }
+
+    outRegions.resize(images.size());
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        const Image& image = images[i];
+        const Placement& placement = placements[i];
+        Image& page = pages[placement.page];
+
+        // Copy the image with its gutter, wrapping around to the opposite edge for the pixels outside of it.
+        const uint32_t* src = (const uint32_t*)image.data;
+        uint32_t* dest = (uint32_t*)page.data;
+        for (int y = -gutter; y < image.height + gutter; ++y)
+        {
+            int srcY = ((y % image.height) + image.height) % image.height;
+            uint32_t* destRow = dest + (size_t)(placement.y + gutter + y) * page.width + placement.x + gutter;
+            for (int x = -gutter; x < image.width + gutter; ++x)
+            {
+                int srcX = ((x % image.width) + image.width) % image.width;
+                destRow[x] = src[(size_t)srcY * image.width + srcX];
+            }
+        }
+
+        outRegions[i].page = placement.page;
+        outRegions[i].uvRect = Rectangle {
+            (float)(placement.x + gutter) / page.width,
+            (float)(placement.y + gutter) / page.height,
+            (float)image.width / page.width,
+            (float)image.height / page.height
+        };
+    }
+
+    return pages;
+}
@@ -0,0 +1,41 @@
+/**
+ * Copyright (c) 2022-present Alexander Lunsford
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty.  In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would be
+ *    appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be
+ *    misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ **/
+
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include "raylib.h"
+
+#include <vector>
+
+// Where an image was placed in a texture atlas
+struct AtlasRegion
+{
+    int page; // Index of the atlas image
+    Rectangle uvRect; // Normalized coordinates of the image in the page, not including its gutter
+};
+
+// Packs RGBA8 images into pages that are at most `maxSize` pixels on each side, using as few pages as possible.
+// Each image is surrounded by `gutter` pixels copied from its opposite edges, so that filtering and mipmaps act as if it repeats.
+// Images too big to fit get a page of their own.
+// The region of each image is written to `outRegions` in the same order. The returned pages must be unloaded by the caller.
+std::vector<Image> PackTextureAtlas(const std::vector<Image>& images, int gutter, int maxSize, std::vector<AtlasRegion>& outRegions);
+
+#endif
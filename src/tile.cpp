@@ -25,19 +25,119 @@
 #include <assert.h>
 #include <iostream>
 #include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <limits>
+#include <unordered_set>
 
 #include "assets.hpp"
 #include "app.hpp"
 #include "map_man/map_man.hpp"
 #include "c_helpers.hpp"
 
+// How much darker a vertex gets when the cels in front of it are completely filled.
+#define AO_STRENGTH 0.8f
+// How much of the light a cel with a shape other than a full cube blocks.
+#define AO_PARTIAL_OCCLUSION 0.5f
+
+Tile TransformTile(Tile tile, TileTransform transform)
+{
+    // For each transform, the new orientation of each of the 16 combinations of yaw and pitch (yaw + pitch * 4).
+    // They are found once by comparing the transformed rotation matrices to the matrices of every orientation.
+    static const auto ORIENTATION_TABLE = []()
+    {
+        const int TRANSFORM_COUNT = (int)TileTransform::MIRROR_Z + 1;
+        std::array<std::array<uint8_t, 16>, TRANSFORM_COUNT> table;
+        for (int t = 0; t < TRANSFORM_COUNT; ++t)
+        {
+            Matrix transformMatrix = TileTransformMatrix((TileTransform)t);
+            bool mirror = MatrixDeterminant(transformMatrix) < 0.0f;
+            for (int from = 0; from < 16; ++from)
+            {
+                // Rotations are applied after the tile's own rotation, while mirrors reflect the rotation itself.
+                Matrix rotation = TileRotationMatrix(from % 4, from / 4);
+                Matrix target = mirror ? (transformMatrix * rotation * transformMatrix) : (rotation * transformMatrix);
+                table[t][from] = from;
+                for (int to = 0; to < 16; ++to)
+                {
+                    float16 a = MatrixToFloatV(target);
+                    float16 b = MatrixToFloatV(TileRotationMatrix(to % 4, to / 4));
+                    if (std::equal(a.v, a.v + 16, b.v, [](float x, float y){ return fabsf(x - y) < 0.001f; }))
+                    {
+                        table[t][from] = to;
+                        break;
+                    }
+                }
+            }
+        }
+        return table;
+    }();
+
+    uint8_t orientation = ORIENTATION_TABLE[(int)transform][(tile.yaw % 4) + (tile.pitch % 4) * 4];
+    tile.yaw = orientation % 4;
+    tile.pitch = orientation / 4;
+    return tile;
+}
+
+uint16_t PaletteTileStorage::Pack(const Tile &tile)
+{
+    if (!tile) return 0;
+    uint64_t key = TileKey(tile);
+    auto found = _palette->indices.find(key);
+    if (found != _palette->indices.end()) return found->second;
+
+    assert(_palette->tiles.size() < MAX_PALETTE_SIZE);
+    if (_palette.use_count() > 1) _palette = std::make_shared<Palette>(*_palette);
+    uint16_t index = uint16_t(_palette->tiles.size());
+    _palette->tiles.push_back(tile);
+    _palette->indices.emplace(key, index);
+    return index;
+}
+
+uint32_t LocalTilePalette::Add(const Tile &tile)
+{
+    if (!tile) return 0;
+    auto [found, added] = _indices.emplace(TileKey(tile), uint32_t(_tiles.size()));
+    if (added) _tiles.push_back(tile);
+    return found->second;
+}
+
+bool PaletteTileStorage::CanPack(const std::vector<Tile> &tiles) const
+{
+    std::unordered_set<uint64_t> newKeys;
+    for (const Tile& tile : tiles)
+    {
+        if (!tile) continue;
+        uint64_t key = TileKey(tile);
+        if (_palette->indices.count(key) == 0) newKeys.insert(key);
+    }
+    return _palette->tiles.size() + newKeys.size() <= MAX_PALETTE_SIZE;
+}
+
+std::vector<uint16_t> PaletteTileStorage::Compact(const std::vector<bool> &used)
+{
+    auto compacted = std::make_shared<Palette>();
+    std::vector<uint16_t> newIndices(_palette->tiles.size(), 0);
+    compacted->tiles.push_back(Tile());
+    for (size_t p = 1; p < _palette->tiles.size(); ++p)
+    {
+        if (!used[p]) continue;
+        const Tile& tile = _palette->tiles[p];
+        newIndices[p] = uint16_t(compacted->tiles.size());
+        compacted->indices.emplace(TileKey(tile), newIndices[p]);
+        compacted->tiles.push_back(tile);
+    }
+    _palette = compacted;
+    return newIndices;
+}
+
 TileGrid::TileGrid(MapMan& mapMan, size_t width, size_t height, size_t length)
     : TileGrid(mapMan, width, height, length, TILE_SPACING_DEFAULT, Tile())
 {
 }
 
 TileGrid::TileGrid(MapMan& mapMan, size_t width, size_t height, size_t length, float spacing, Tile fill)
-    : Grid<Tile>(width, height, length, spacing, fill),
+    : TileGridBase(width, height, length, spacing, fill),
     _mapMan(mapMan)
 {
     _batchFromY = 0;
@@ -56,45 +156,57 @@ Tile TileGrid::GetTile(int i, int j, int k) const
 
 Tile TileGrid::GetTile(int flatIndex) const
 {
-    return _grid[flatIndex];
+    return _GetCelAt(flatIndex);
 }
 
-void TileGrid::SetTile(int i, int j, int k, const Tile& tile) 
+bool TileGrid::SetTile(int i, int j, int k, const Tile& tile) 
 {
-    SetCel(i, j, k, tile);
+    if (!SetCel(i, j, k, tile)) return false;
     _shouldRegenBatches = true;
     _regenModel = true;
+    return true;
 }
 
-void TileGrid::SetTile(int flatIndex, const Tile& tile)
+bool TileGrid::SetTile(int flatIndex, const Tile& tile)
 {
-    _grid[flatIndex] = tile;
+    if (!_ReplaceCel(flatIndex, tile)) return false;
     _shouldRegenBatches = true;
     _regenModel = true;
+    return true;
 }
 
-void TileGrid::SetTileRect(int i, int j, int k, int w, int h, int l, const Tile& tile)
+bool TileGrid::SetTileRun(size_t flatIndex, size_t count, const Tile& tile)
+{
+    if (!_FillCels(flatIndex, count, tile)) return false;
+    _shouldRegenBatches = true;
+    _regenModel = true;
+    return true;
+}
+
+bool TileGrid::SetTileRect(int i, int j, int k, int w, int h, int l, const Tile& tile)
 {
     assert(i >= 0 && j >= 0 && k >= 0);
     assert(i + w <= int(_width) && j + h <= int(_height) && k + l <= int(_length));
+    if (!MakeRoomForTiles({ tile })) return false;
     for (int y = j; y < j + h; ++y)
     {
         for (int z = k; z < k + l; ++z)
         {
-            size_t base = FlatIndex(0, y, z);
             for (int x = i; x < i + w; ++x)
             {
-                _grid[base + x] = tile;
+                _ReplaceCel(x, y, z, tile);
             }
         }
     }
     _shouldRegenBatches = true;
     _regenModel = true;
+    return true;
 }
 
-void TileGrid::CopyTiles(int i, int j, int k, const TileGrid &src, bool ignoreEmpty)
+bool TileGrid::CopyTiles(int i, int j, int k, const TileGrid &src, bool ignoreEmpty)
 {
     assert(i >= 0 && j >= 0 && k >= 0);
+    if (!_MakeRoomFor(src)) return false;
     int xEnd = Min(i + int(src._width), int(_width));
     int yEnd = Min(j + int(src._height), int(_height));
     int zEnd = Min(k + int(src._length), int(_length));
@@ -102,25 +214,24 @@ void TileGrid::CopyTiles(int i, int j, int k, const TileGrid &src, bool ignoreEm
     {
         for (int y = j; y < yEnd; ++y)
         {
-            size_t ourBase = FlatIndex(0, y, z);
-            size_t theirBase = src.FlatIndex(0, y - j, z - k);
-            for (int x = i; x < xEnd; ++x)
-            {
-                const Tile &tile = src._grid[theirBase + (x - i)];
-                if (!ignoreEmpty || tile)
-                {
-                    _grid[ourBase + x] = tile;
-                }
-            }
+            _CopyRow(i, y, z, src, 0, y - j, z - k, xEnd - i, ignoreEmpty);
         }
     }
     _shouldRegenBatches = true;
     _regenModel = true;
+    return true;
+}
+
+bool TileGrid::MakeRoomForTiles(const std::vector<Tile>& tiles)
+{
+    return _MakeRoomFor(tiles);
 }
 
 void TileGrid::UnsetTile(int i, int j, int k) 
 {
-    _grid[FlatIndex(i, j, k)].shape = NO_MODEL;
+    Tile tile = _GetCelAt(i, j, k);
+    tile.shape = NO_MODEL;
+    _ReplaceCel(i, j, k, tile);
     _shouldRegenBatches = true;
     _regenModel = true;
 }
@@ -132,13 +243,46 @@ TileGrid TileGrid::Subsection(int i, int j, int k, int w, int h, int l) const
 
     TileGrid newGrid(_mapMan, w, h, l);
 
-    SubsectionCopy(i, j, k, w, h, l, newGrid);
+    if (i == 0 && j == 0 && k == 0 && w == int(_width) && h == int(_height) && l == int(_length))
+    {
+        // A copy of the whole grid can share all of its chunks.
+        static_cast<TileGridBase&>(newGrid) = *this;
+    }
+    else
+    {
+        SubsectionCopy(i, j, k, w, h, l, newGrid);
+    }
 
     newGrid._shouldRegenBatches = true;
 
     return newGrid;
 }
 
+// Storage with a palette already stores palette indices. Tiles in other kinds of storage are added to the local palette.
+template<class Storage>
+static uint32_t ToPaletteIndex(const Storage& storage, const typename Storage::Stored& stored, LocalTilePalette& localPalette)
+{
+    if constexpr (Storage::HAS_PALETTE) return stored;
+    else return localPalette.Add(storage.Unpack(stored));
+}
+
+template<class Storage>
+static const std::vector<Tile>& GetStoragePalette(const Storage& storage, const LocalTilePalette& localPalette)
+{
+    if constexpr (Storage::HAS_PALETTE) return storage.GetPalette();
+    else return localPalette.GetTiles();
+}
+
+uint32_t TileGrid::_GetPaletteIndex(int i, int j, int k, LocalTilePalette& localPalette) const
+{
+    return ToPaletteIndex(_storage, _GetStoredCel(_StorageIndex(i, j, k)), localPalette);
+}
+
+const std::vector<Tile>& TileGrid::_GetPalette(const LocalTilePalette& localPalette) const
+{
+    return GetStoragePalette(_storage, localPalette);
+}
+
 void TileGrid::_RegenBatches(Vector3 position, int fromY, int toY)
 {
     _drawBatches.clear();
@@ -147,33 +291,49 @@ void TileGrid::_RegenBatches(Vector3 position, int fromY, int toY)
     _batchPosition = position;
     _shouldRegenBatches = false;
 
-    const size_t layerArea = _width * _length;
+    // The rotation of each different tile, and the instance arrays for each of its meshes, are looked up the first time it is seen.
+    struct PaletteBatches
+    {
+        bool found = false;
+        Matrix rotation;
+        std::vector<std::vector<Matrix>*> batches;
+    };
+    LocalTilePalette localPalette;
+    std::vector<PaletteBatches> paletteBatches;
+
     // Create a hash map of dynamic arrays for each combination of texture and mesh
     for (int y = fromY; y <= toY; ++y)
     {
-        for (size_t t = y * layerArea; t < (y + 1) * layerArea; ++t) 
+        // Empty layers and rows are skipped without looking at their tiles.
+        if (GetLayerOccupiedCount(y) == 0) continue;
+        for (size_t z = 0; z < _length; ++z)
         {
-            const Tile& tile = _grid[t];
-            if (tile)
+            if (GetRowOccupiedCount(y, z) == 0) continue;
+            for (size_t x = 0; x < _width; ++x) 
             {
-                // Calculate world space matrix for the tile
-                Vector3 gridPos = UnflattenIndex(t);
-                Vector3 worldPos = position + GridToWorldPos(gridPos, true);
-                Matrix rotMatrix = TileRotationMatrix(tile.yaw, tile.pitch);
-                Matrix matrix = rotMatrix * MatrixTranslate(worldPos.x, worldPos.y, worldPos.z);
-
-                const Model &shape = _mapMan.get().ModelFromID(tile.shape);
-                for (int m = 0; m < shape.meshCount; ++m) 
+                uint32_t p = _GetPaletteIndex(x, y, z, localPalette);
+                if (p == 0) continue;
+                if (p >= paletteBatches.size()) paletteBatches.resize(_GetPalette(localPalette).size());
+
+                PaletteBatches& entry = paletteBatches[p];
+                if (!entry.found)
                 {
-                    // Add the tile's transform to the instance arrays for each mesh
-                    auto pair = std::make_pair(tile.textures[Min(m, TEXTURES_PER_TILE)], &shape.meshes[m]);
-                    if (_drawBatches.find(pair) == _drawBatches.end()) 
+                    const Tile tile = _GetPalette(localPalette)[p];
+                    entry.found = true;
+                    entry.rotation = TileRotationMatrix(tile.yaw, tile.pitch);
+                    const Model &shape = _mapMan.get().ModelFromID(tile.shape);
+                    for (int m = 0; m < shape.meshCount; ++m) 
                     {
-                        // Put in a vector for this pair if there hasn't been one already
-                        _drawBatches[pair] = std::vector<Matrix>();
+                        // Put in a vector for each texture and mesh pair if there hasn't been one already
+                        auto pair = std::make_pair(tile.textures[Min(m, TEXTURES_PER_TILE - 1)], &shape.meshes[m]);
+                        entry.batches.push_back(&_drawBatches[pair]);
                     }
-                    _drawBatches[pair].push_back(matrix);
                 }
+
+                // Calculate world space matrix for the tile, and add it to the instance arrays for each mesh
+                Vector3 worldPos = position + GridToWorldPos(Vector3 { (float)x, (float)y, (float)z }, true);
+                Matrix matrix = entry.rotation * MatrixTranslate(worldPos.x, worldPos.y, worldPos.z);
+                for (std::vector<Matrix>* batch : entry.batches) batch->push_back(matrix);
             }
         }
     }
@@ -231,14 +391,14 @@ static void AppendBytes(std::vector<uint8_t>& bytes, T value)
 std::string TileGrid::GetTileDataBase64() const
 {
     std::vector<uint8_t> bin;
-    bin.reserve(_grid.size() * sizeof(Tile));
+    bin.reserve(_celCount * sizeof(Tile));
 
     ModelID runLength = 0;
-    for (size_t i = 0; i < _grid.size(); ++i)
+    for (size_t i = 0; i < _celCount; ++i)
     {
-        Tile savedTile = _grid[i];
+        Tile savedTile = _GetCelAt(i);
 
-        if (!savedTile && i < _grid.size() - 1 && runLength < INT16_MAX)
+        if (!savedTile && i < _celCount - 1 && runLength < INT16_MAX)
         {
             // Blank tiles (except for the last tile in the grid) are represented as runs.
             ++runLength;
@@ -247,7 +407,7 @@ std::string TileGrid::GetTileDataBase64() const
         { 
             if (runLength > 0)
             {
-                if (i == _grid.size() - 1)
+                if (i == _celCount - 1)
                 {
                     // Accounts for the final tile being reached during a run of empty tiles.
                     ++runLength;
@@ -279,6 +439,40 @@ std::string TileGrid::GetTileDataBase64() const
     return base64::encode(bin);
 }
 
+// Reads a little endian value from `bytes` at `byteIndex` and advances the index past it.
+// The value is copied out byte by byte, so the data does not have to be aligned.
+template<typename T>
+static T ReadBytes(const std::vector<uint8_t>& bytes, size_t& byteIndex)
+{
+    if (byteIndex + sizeof(T) > bytes.size())
+    {
+        throw std::runtime_error("Tile data is truncated");
+    }
+
+    static const uint16_t testInt = 1;
+    static const bool bigEndian = !*(unsigned char *)&testInt;
+
+    uint8_t valueBytes[sizeof(T)];
+    for (size_t b = 0; b < sizeof(T); ++b)
+    {
+        valueBytes[bigEndian ? sizeof(T) - 1 - b : b] = bytes[byteIndex + b];
+    }
+    byteIndex += sizeof(T);
+
+    T value;
+    memcpy(&value, valueBytes, sizeof(T));
+    return value;
+}
+
+void TileGrid::_FillEmptyRun(size_t gridIndex, size_t runLength)
+{
+    if (runLength > _celCount - gridIndex)
+    {
+        throw std::runtime_error("Tile data has a run of empty tiles that goes past the end of the grid");
+    }
+    _FillCels(gridIndex, runLength, Tile());
+}
+
 void TileGrid::SetTileDataBase64OldFormat(std::string data)
 {
     std::vector<uint8_t> bin = base64::decode(data);
@@ -287,34 +481,36 @@ void TileGrid::SetTileDataBase64OldFormat(std::string data)
 
     while (byteIndex < bin.size())
     {
-        int32_t oldModelID = *reinterpret_cast<int32_t*>(&bin[byteIndex]);
-        ModelID modelID = (ModelID) oldModelID;
-        byteIndex += sizeof(int32_t);
+        int32_t oldModelID = ReadBytes<int32_t>(bin, byteIndex);
 
-        if (modelID < 0)
+        if (oldModelID < 0)
         {
-            for (size_t t = 0; t < (size_t)-modelID; ++t)
-            {
-                _grid[gridIndex + t] = Tile();
-            }
-            gridIndex += -modelID;
+            size_t runLength = (size_t)(-(int64_t)oldModelID);
+            _FillEmptyRun(gridIndex, runLength);
+            gridIndex += runLength;
+            // Empty tiles still had their angle, texture, and pitch written out.
             byteIndex += 3 * sizeof(int32_t);
             continue;
         }
 
-        int32_t angle = *reinterpret_cast<int32_t*>(&bin[byteIndex]);
+        if (gridIndex >= _celCount)
+        {
+            throw std::runtime_error("Tile data has more tiles than the grid");
+        }
+
+        int32_t angle = ReadBytes<int32_t>(bin, byteIndex);
         uint8_t yaw = (uint8_t)((angle % 360) / 90);
-        byteIndex += sizeof(int32_t);
 
-        int32_t oldTexID = *reinterpret_cast<int32_t*>(&bin[byteIndex]); 
+        int32_t oldTexID = ReadBytes<int32_t>(bin, byteIndex);
         TexID texID = (TexID) oldTexID;
-        byteIndex += sizeof(int32_t);
 
-        int32_t oldPitch = *reinterpret_cast<int32_t*>(&bin[byteIndex]);
+        int32_t oldPitch = ReadBytes<int32_t>(bin, byteIndex);
         uint8_t pitch = (uint8_t)((oldPitch % 360) / 90);
-        byteIndex += sizeof(int32_t);
 
-        _grid[gridIndex] = Tile(modelID, texID, texID, yaw, pitch);
+        if (!_ReplaceCel(gridIndex, Tile((ModelID) oldModelID, texID, texID, yaw, pitch)))
+        {
+            throw std::runtime_error("Tile data has tiles that the grid can't store");
+        }
         ++gridIndex;
     }
 
@@ -329,32 +525,30 @@ void TileGrid::SetTileDataBase64(std::string data)
 
     while (byteIndex < bin.size())
     {
-        ModelID modelID = *reinterpret_cast<ModelID*>(&bin[byteIndex]);
-        byteIndex += sizeof(ModelID);
+        ModelID modelID = ReadBytes<ModelID>(bin, byteIndex);
 
         if (modelID < 0)
         {
-            for (size_t t = 0; t < (size_t)(-modelID); ++t)
-            {
-                _grid[gridIndex + t] = Tile();
-            }
-            gridIndex += -modelID;
+            size_t runLength = (size_t)(-(int32_t)modelID);
+            _FillEmptyRun(gridIndex, runLength);
+            gridIndex += runLength;
             continue;
         }
 
-        TexID tex1ID = *reinterpret_cast<TexID*>(&bin[byteIndex]);
-        byteIndex += sizeof(TexID);
-
-        TexID tex2ID = *reinterpret_cast<TexID*>(&bin[byteIndex]);
-        byteIndex += sizeof(TexID);
+        if (gridIndex >= _celCount)
+        {
+            throw std::runtime_error("Tile data has more tiles than the grid");
+        }
 
-        uint8_t yaw = *reinterpret_cast<uint8_t*>(&bin[byteIndex]);
-        byteIndex += sizeof(uint8_t);
-        
-        uint8_t pitch = *reinterpret_cast<uint8_t*>(&bin[byteIndex]);
-        byteIndex += sizeof(uint8_t);
+        TexID tex1ID = ReadBytes<TexID>(bin, byteIndex);
+        TexID tex2ID = ReadBytes<TexID>(bin, byteIndex);
+        uint8_t yaw = ReadBytes<uint8_t>(bin, byteIndex);
+        uint8_t pitch = ReadBytes<uint8_t>(bin, byteIndex);
 
-        _grid[gridIndex] = Tile(modelID, tex1ID, tex2ID, yaw, pitch);
+        if (!_ReplaceCel(gridIndex, Tile(modelID, tex1ID, tex2ID, yaw, pitch)))
+        {
+            throw std::runtime_error("Tile data has tiles that the grid can't store");
+        }
         ++gridIndex;
     }
 
@@ -365,8 +559,9 @@ std::pair<std::vector<TexID>, std::vector<ModelID>> TileGrid::GetUsedIDs() const
 {
     std::set<TexID> usedTexIDs;
     std::set<ModelID> usedModelIDs;
-    for (const Tile& tile : _grid)
+    for (size_t t = 0; t < _celCount; ++t)
     {
+        const Tile& tile = _GetCelAt(t);
         if (tile)
         {
             for (const TexID tex : tile.textures) usedTexIDs.insert(tex);
@@ -380,197 +575,565 @@ std::pair<std::vector<TexID>, std::vector<ModelID>> TileGrid::GetUsedIDs() const
         std::vector(usedModelIDs.begin(), usedModelIDs.end()));
 }
 
-Model* TileGrid::_GenerateModel(bool culling)
+bool TileGrid::_IsFaceHidden(Vector3 v0, Vector3 v1, Vector3 v2, int i, int j, int k) const
 {
-    _RegenBatches(Vector3Zero(), 0, _height - 1);
+    // Figure out if this triangle is near the border of the grid cel so it can be culled
+    Vector3 planeNormal = Vector3CrossProduct(v1 - v0, v2 - v0);
+    planeNormal = Vector3Normalize(planeNormal);
+
+    float planeDistance = -Vector3DotProduct(planeNormal, v0);
+
+    // Determine the direction of the tile neighboring this face
+    int neighborX = i;
+    int neighborY = j; 
+    int neighborZ = k;
+    if      (planeNormal == Vector3 { +1.0f,  0.0f,  0.0f }) neighborX += 1;
+    else if (planeNormal == Vector3 { -1.0f,  0.0f,  0.0f }) neighborX -= 1;
+    else if (planeNormal == Vector3 {  0.0f,  0.0f, -1.0f }) neighborZ -= 1;
+    else if (planeNormal == Vector3 {  0.0f,  0.0f, +1.0f }) neighborZ += 1;
+    else if (planeNormal == Vector3 {  0.0f, +1.0f,  0.0f }) neighborY += 1;
+    else if (planeNormal == Vector3 {  0.0f, -1.0f,  0.0f }) neighborY -= 1;
+    else return false;
+
+    // Look at the neighboring tile's faces to determine whether to cull this triangle or not.
+    if (neighborX < 0 || neighborY < 0 || neighborZ < 0 || 
+        (size_t) neighborX >= _width || (size_t) neighborY >= _height || (size_t) neighborZ >= _length)
+    {
+        return false;
+    }
+
+    Tile neighborTile = GetTile(neighborX, neighborY, neighborZ);
+    if (!neighborTile) 
+    {
+        return false;
+    }
+    
+    Vector3 nWorldPos = GridToWorldPos(Vector3 { (float)neighborX, (float)neighborY, (float)neighborZ }, true);
+    Matrix nRotMatrix = TileRotationMatrix(neighborTile.yaw, neighborTile.pitch);
+    Matrix nMatrix = MatrixMultiply(nRotMatrix, MatrixTranslate(nWorldPos.x, nWorldPos.y, nWorldPos.z));
 
-    // Collects vertex data for one of the model's meshes
-    // There is one mesh per texture in the model, which contains all of the geometry with said texture.
-    struct DynMesh 
+    Model neighborModel = _mapMan.get().ModelFromID(neighborTile.shape);
+    for (int nm = 0; nm < neighborModel.meshCount; ++nm)
     {
-        std::vector<float> positions;
+        Mesh neighborMesh = neighborModel.meshes[nm];
+        if (neighborMesh.vertices == NULL) continue;
+        for (int nt = 0; nt < neighborMesh.triangleCount; ++nt)
+        {
+            // Indices
+            int nV0Index = (neighborMesh.indices != NULL) ? neighborMesh.indices[nt * 3 + 0] : nt * 3 + 0;
+            int nV1Index = (neighborMesh.indices != NULL) ? neighborMesh.indices[nt * 3 + 1] : nt * 3 + 1;
+            int nV2Index = (neighborMesh.indices != NULL) ? neighborMesh.indices[nt * 3 + 2] : nt * 3 + 2;
+
+            // Vertices
+            Vector3 nV0 = Vector3 { neighborMesh.vertices[nV0Index * 3 + 0], neighborMesh.vertices[nV0Index * 3 + 1], neighborMesh.vertices[nV0Index * 3 + 2] };
+            nV0 = Vector3Transform(nV0, nMatrix);
+            Vector3 nV1 = Vector3 { neighborMesh.vertices[nV1Index * 3 + 0], neighborMesh.vertices[nV1Index * 3 + 1], neighborMesh.vertices[nV1Index * 3 + 2] };
+            nV1 = Vector3Transform(nV1, nMatrix);
+            Vector3 nV2 = Vector3 { neighborMesh.vertices[nV2Index * 3 + 0], neighborMesh.vertices[nV2Index * 3 + 1], neighborMesh.vertices[nV2Index * 3 + 2] };
+            nV2 = Vector3Transform(nV2, nMatrix);
+
+            // Get neighbor's plane
+            Vector3 nPlaneNormal = Vector3CrossProduct(nV1 - nV0, nV2 - nV0);
+            nPlaneNormal = Vector3Normalize(nPlaneNormal);
+
+            float nPlaneDistance = -Vector3DotProduct(nPlaneNormal, nV0);
+
+            // If the plane of the cullable triangle and the plane of the neighbor's triangle are in the same spot but opposite directions...
+            if (FloatEquals(fabs(nPlaneDistance), fabs(planeDistance)) && FloatEquals(Vector3DotProduct(nPlaneNormal, planeNormal), -1.0f))
+            {
+                // Cull if all of the checked triangle's points correspond one of the neighbor's.
+                if (
+                    (v0 == nV0 || v0 == nV1 || v0 == nV2) && 
+                    (v1 == nV0 || v1 == nV1 || v1 == nV2) && 
+                    (v2 == nV0 || v2 == nV1 || v2 == nV2))
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+std::vector<TileMesh> TileGrid::GenerateMeshes(int i, int j, int k, int w, int h, int l, bool culling, const std::vector<bool>* excludedShapes) const
+{
+    assert(i >= 0 && j >= 0 && k >= 0);
+    assert(i + w <= int(_width) && j + h <= int(_height) && k + l <= int(_length));
+
+    // There is one mesh per texture, which contains all of the geometry with said texture.
+    std::vector<TileMesh> meshes;
+    std::map<TexID, size_t> meshIndices;
+
+    // The parts of each different tile's geometry that don't depend on its position are found the first time it is seen.
+    struct PaletteGeometry
+    {
+        const Mesh* shape;
+        size_t meshIndex;
+        std::vector<float> positions; // Rotated, but not moved to the tile's position
         std::vector<float> texCoords;
         std::vector<float> normals;
-        std::vector<unsigned short> indices;
-        int triCount; // Independent form indices count since some models may not have indices
     };
-
-    DynMesh meshMap[_mapMan.get().GetNumTextures()];
-    for (auto& dynMesh : meshMap)
+    struct PaletteEntry
     {
-        dynMesh.positions = std::vector<float>();
-        dynMesh.texCoords = std::vector<float>();
-        dynMesh.normals = std::vector<float>();
-        dynMesh.indices = std::vector<unsigned short>();
-        dynMesh.triCount = 0;
-    }
+        bool found = false;
+        std::vector<PaletteGeometry> geometry;
+    };
+    LocalTilePalette localPalette;
+    std::vector<PaletteEntry> paletteEntries;
 
-    for (const auto& [pair, matrices] : _drawBatches)
+    for (int y = j; y < j + h; ++y)
     {
-        Mesh &shape = *pair.second;
-        DynMesh &mesh = meshMap[pair.first];
-        //Generate vertex data for this tile.
-        for (const Matrix &matrix : matrices)
+        for (int z = k; z < k + l; ++z)
         {
-            // The index of the first vertex belonging to this shape.
-            int vBase = mesh.positions.size() / 3;
-            // Add vertex data
-            for (int v = 0; v < shape.vertexCount; v++)
+            for (int x = i; x < i + w; ++x)
             {
-                if (shape.vertices != NULL)
+                uint32_t p = _GetPaletteIndex(x, y, z, localPalette);
+                if (p == 0) continue;
+                if (p >= paletteEntries.size()) paletteEntries.resize(_GetPalette(localPalette).size());
+
+                PaletteEntry& entry = paletteEntries[p];
+                if (!entry.found)
                 {
-                    //Transform shape vertices into tile's orientation and position
-                    Vector3 vec = Vector3 { shape.vertices[v*3], shape.vertices[v*3 + 1], shape.vertices[v*3 + 2] };
-                    vec = vec * matrix;
-                    mesh.positions.push_back(vec.x);
-                    mesh.positions.push_back(vec.y);
-                    mesh.positions.push_back(vec.z);
+                    const Tile tile = _GetPalette(localPalette)[p];
+                    entry.found = true;
+                    if (excludedShapes != nullptr && tile.shape < (ModelID)excludedShapes->size() && (*excludedShapes)[tile.shape]) continue;
+
+                    // Transform normals by the tile's rotation, but not its position
+                    Matrix rotMatrix = TileRotationMatrix(tile.yaw, tile.pitch);
+
+                    const Model shapeModel = _mapMan.get().ModelFromID(tile.shape);
+                    for (int m = 0; m < shapeModel.meshCount; ++m)
+                    {
+                        const Mesh& shape = shapeModel.meshes[m];
+                        if (shape.vertices == NULL) continue;
+
+                        TexID texID = tile.textures[Min(m, TEXTURES_PER_TILE - 1)];
+                        auto [meshIter, isNew] = meshIndices.emplace(texID, meshes.size());
+                        if (isNew)
+                        {
+                            meshes.emplace_back();
+                            meshes.back().texture = texID;
+                        }
+
+                        PaletteGeometry geometry = { &shape, meshIter->second };
+                        for (int v = 0; v < shape.vertexCount; v++)
+                        {
+                            //Transform shape vertices into tile's orientation
+                            Vector3 vec = Vector3 { shape.vertices[v*3], shape.vertices[v*3 + 1], shape.vertices[v*3 + 2] } * rotMatrix;
+                            geometry.positions.insert(geometry.positions.end(), { vec.x, vec.y, vec.z });
+
+                            // Missing normals and tex coords are filled with zeroes to keep the arrays the same length
+                            Vector3 norm = Vector3Zero();
+                            if (shape.normals != NULL)
+                            {
+                                norm = Vector3Transform(Vector3 { shape.normals[v*3], shape.normals[v*3 + 1], shape.normals[v*3 + 2] }, rotMatrix);
+                            }
+                            geometry.normals.insert(geometry.normals.end(), { norm.x, norm.y, norm.z });
+
+                            if (shape.texcoords != NULL)
+                                geometry.texCoords.insert(geometry.texCoords.end(), { shape.texcoords[v*2], shape.texcoords[v*2 + 1] });
+                            else
+                                geometry.texCoords.insert(geometry.texCoords.end(), { 0.0f, 0.0f });
+                        }
+                        entry.geometry.push_back(std::move(geometry));
+                    }
                 }
 
-                if (shape.normals != NULL)
+                Vector3 worldPos = GridToWorldPos(Vector3 { (float)x, (float)y, (float)z }, true);
+                for (const PaletteGeometry& geometry : entry.geometry)
                 {
-                    //Transform normals by the tile's rotation, but not its position
-                    Matrix rotMatrix = matrix;
-                    rotMatrix.m12 = 0.0f;
-                    rotMatrix.m13 = 0.0f;
-                    rotMatrix.m14 = 0.0f;
-                    
-                    Vector3 norm = Vector3 { shape.normals[v*3], shape.normals[v*3 + 1], shape.normals[v*3 + 2] };
-                    norm = Vector3Transform(norm, rotMatrix);
-                    mesh.normals.push_back(norm.x);
-                    mesh.normals.push_back(norm.y);
-                    mesh.normals.push_back(norm.z);
+                    const Mesh& shape = *geometry.shape;
+                    TileMesh& mesh = meshes[geometry.meshIndex];
+
+                    // The index of the first vertex belonging to this shape.
+                    int vBase = mesh.positions.size() / 3;
+                    // Add vertex data, moving the vertices to the tile's position
+                    for (size_t v = 0; v < geometry.positions.size(); v += 3)
+                    {
+                        mesh.positions.insert(mesh.positions.end(), { geometry.positions[v] + worldPos.x, geometry.positions[v + 1] + worldPos.y, geometry.positions[v + 2] + worldPos.z });
+                    }
+                    mesh.normals.insert(mesh.normals.end(), geometry.normals.begin(), geometry.normals.end());
+                    //Tex coordinates are just copied into the aggregate mesh
+                    mesh.texCoords.insert(mesh.texCoords.end(), geometry.texCoords.begin(), geometry.texCoords.end());
+
+                    // Add face data
+                    for (int tri = 0; tri < shape.triangleCount; ++tri)
+                    {
+                        // Vertex indices, with the offset of the current tile's vertices. Shapes without indices are plain triangle lists.
+                        uint16_t v0Index = (uint16_t)(vBase + ((shape.indices != NULL) ? shape.indices[tri * 3 + 0] : tri * 3 + 0));
+                        uint16_t v1Index = (uint16_t)(vBase + ((shape.indices != NULL) ? shape.indices[tri * 3 + 1] : tri * 3 + 1));
+                        uint16_t v2Index = (uint16_t)(vBase + ((shape.indices != NULL) ? shape.indices[tri * 3 + 2] : tri * 3 + 2));
+
+                        // Do face culling
+                        if (culling)
+                        {
+                            Vector3 v0 = Vector3 { mesh.positions[v0Index * 3 + 0], mesh.positions[v0Index * 3 + 1], mesh.positions[v0Index * 3 + 2] };
+                            Vector3 v1 = Vector3 { mesh.positions[v1Index * 3 + 0], mesh.positions[v1Index * 3 + 1], mesh.positions[v1Index * 3 + 2] };
+                            Vector3 v2 = Vector3 { mesh.positions[v2Index * 3 + 0], mesh.positions[v2Index * 3 + 1], mesh.positions[v2Index * 3 + 2] };
+                            if (_IsFaceHidden(v0, v1, v2, x, y, z)) continue;
+                        }
+
+                        mesh.indices.insert(mesh.indices.end(), { v0Index, v1Index, v2Index });
+                    }
                 }
+            }
+        }
+    }
+
+    // We don't want to include any empty meshes, because that will cause an error in certain .gltf parsers.
+    meshes.erase(std::remove_if(meshes.begin(), meshes.end(), [](const TileMesh& mesh){ return mesh.indices.empty(); }), meshes.end());
+
+    return meshes;
+}
 
-                if (shape.texcoords != NULL)
+std::vector<bool> TileGrid::GetFullCubeShapes() const
+{
+    std::vector<bool> fullCubes;
+    const float halfSize = _spacing / 2.0f;
+    const float sideArea = _spacing * _spacing;
+    for (ModelID id = 0; id < (ModelID)_mapMan.get().GetNumModels(); ++id)
+    {
+        // A shape is a full cube if it stays inside of the cel and its faces on the cel's 6 sides cover all of them.
+        const Model shapeModel = _mapMan.get().ModelFromID(id);
+        float sideAreas[6] = { 0.0f };
+        bool inside = true;
+        for (int m = 0; m < shapeModel.meshCount; ++m)
+        {
+            const Mesh& shape = shapeModel.meshes[m];
+            if (shape.vertices == NULL) continue;
+            for (int v = 0; v < shape.vertexCount * 3; ++v)
+            {
+                if (fabsf(shape.vertices[v]) > halfSize + 0.001f) inside = false;
+            }
+            for (int tri = 0; tri < shape.triangleCount; ++tri)
+            {
+                Vector3 corners[3];
+                for (int c = 0; c < 3; ++c)
                 {
-                    //Tex coordinates are just copied into the aggregate mesh
-                    mesh.texCoords.push_back(shape.texcoords[v*2]);
-                    mesh.texCoords.push_back(shape.texcoords[v*2 + 1]);
+                    int v = (shape.indices != NULL) ? shape.indices[tri * 3 + c] : tri * 3 + c;
+                    corners[c] = Vector3 { shape.vertices[v * 3], shape.vertices[v * 3 + 1], shape.vertices[v * 3 + 2] };
+                }
+                Vector3 cross = Vector3CrossProduct(corners[1] - corners[0], corners[2] - corners[0]);
+                Vector3 normal = Vector3Normalize(cross);
+                const float normalComps[3] = { normal.x, normal.y, normal.z };
+                const float cornerComps[3] = { corners[0].x, corners[0].y, corners[0].z };
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    // The triangle has to face outward, and lie on the side
+                    if (fabsf(fabsf(normalComps[axis]) - 1.0f) > 0.001f) continue;
+                    if (fabsf(cornerComps[axis] - copysignf(halfSize, normalComps[axis])) > 0.001f) continue;
+                    sideAreas[axis * 2 + (normalComps[axis] > 0.0f ? 1 : 0)] += Vector3Length(cross) / 2.0f;
                 }
             }
-            // Add face data
-            if (shape.indices != NULL)
+        }
+        fullCubes.push_back(inside && std::all_of(sideAreas, sideAreas + 6, [&](float area){ return area >= sideArea * 0.999f; }));
+    }
+    return fullCubes;
+}
+
+TileCollision TileGrid::GenerateCollision(int i, int j, int k, int w, int h, int l, const std::vector<bool>& fullCubeShapes) const
+{
+    TileCollision collision;
+
+    // Find the cels that are filled by cubes
+    std::vector<bool> solid(w * h * l, false);
+    auto localIndex = [&](int x, int y, int z){ return x + z * w + y * w * l; };
+    for (int y = 0; y < h; ++y)
+    {
+        for (int z = 0; z < l; ++z)
+        {
+            for (int x = 0; x < w; ++x)
             {
-                for (int tri = 0; tri < shape.triangleCount; ++tri)
+                const Tile& tile = _GetCelAt(i + x, j + y, k + z);
+                solid[localIndex(x, y, z)] = IsFullCube(tile, fullCubeShapes);
+            }
+        }
+    }
+
+    // Greedily grow boxes out of the solid cels, first along X, then Z, then Y.
+    for (int y = 0; y < h; ++y)
+    {
+        for (int z = 0; z < l; ++z)
+        {
+            for (int x = 0; x < w; ++x)
+            {
+                if (!solid[localIndex(x, y, z)]) continue;
+
+                int sizeX = 1;
+                while (x + sizeX < w && solid[localIndex(x + sizeX, y, z)]) ++sizeX;
+
+                auto isRowSolid = [&](int rowY, int rowZ){
+                    for (int rx = x; rx < x + sizeX; ++rx)
+                    {
+                        if (!solid[localIndex(rx, rowY, rowZ)]) return false;
+                    }
+                    return true;
+                };
+
+                int sizeZ = 1;
+                while (z + sizeZ < l && isRowSolid(y, z + sizeZ)) ++sizeZ;
+
+                int sizeY = 1;
+                for (bool layerSolid = true; y + sizeY < h && layerSolid; )
                 {
-                    // Vertex indices
-                    uint16_t v0Index = (uint16_t)(vBase + shape.indices[tri * 3 + 0]);
-                    uint16_t v1Index = (uint16_t)(vBase + shape.indices[tri * 3 + 1]);
-                    uint16_t v2Index = (uint16_t)(vBase + shape.indices[tri * 3 + 2]);
+                    for (int rz = z; rz < z + sizeZ && layerSolid; ++rz)
+                    {
+                        layerSolid = isRowSolid(y + sizeY, rz);
+                    }
+                    if (layerSolid) ++sizeY;
+                }
 
-                    // Do face culling
-                    if (culling)
+                for (int by = y; by < y + sizeY; ++by)
+                {
+                    for (int bz = z; bz < z + sizeZ; ++bz)
                     {
-                        // Vertices
-                        Vector3 v0 = Vector3 { mesh.positions[v0Index * 3 + 0], mesh.positions[v0Index * 3 + 1], mesh.positions[v0Index * 3 + 2] };
-                        Vector3 v1 = Vector3 { mesh.positions[v1Index * 3 + 0], mesh.positions[v1Index * 3 + 1], mesh.positions[v1Index * 3 + 2] };
-                        Vector3 v2 = Vector3 { mesh.positions[v2Index * 3 + 0], mesh.positions[v2Index * 3 + 1], mesh.positions[v2Index * 3 + 2] };
-
-                        // Figure out if this triangle is near the border of the grid cel so it can be culled
-                        Vector3 planeNormal = Vector3CrossProduct(v1 - v0, v2 - v0);
-                        planeNormal = Vector3Normalize(planeNormal);
-
-                        float planeDistance = -Vector3DotProduct(planeNormal, v0);
-
-                        Vector3 tileGridPosition = WorldToGridPos(Vector3 { matrix.m12, matrix.m13, matrix.m14 });
-                        
-                        // Determine the direction of the tile neighboring this face
-                        int neighborX = (int)tileGridPosition.x;
-                        int neighborY = (int)tileGridPosition.y; 
-                        int neighborZ = (int)tileGridPosition.z;
-                        if      (planeNormal == Vector3 { +1.0f,  0.0f,  0.0f }) neighborX += 1;
-                        else if (planeNormal == Vector3 { -1.0f,  0.0f,  0.0f }) neighborX -= 1;
-                        else if (planeNormal == Vector3 {  0.0f,  0.0f, -1.0f }) neighborZ -= 1;
-                        else if (planeNormal == Vector3 {  0.0f,  0.0f, +1.0f }) neighborZ += 1;
-                        else if (planeNormal == Vector3 {  0.0f, +1.0f,  0.0f }) neighborY += 1;
-                        else if (planeNormal == Vector3 {  0.0f, -1.0f,  0.0f }) neighborY -= 1;
-                        else goto nocull;
-
-                        // Look at the neighboring tile's faces to determine whether to cull this triangle or not.
-                        if (neighborX >= 0 && neighborY >= 0 && neighborZ >= 0 && 
-                            (size_t) neighborX < _width && (size_t) neighborY < _height && (size_t) neighborZ < _length)
+                        for (int bx = x; bx < x + sizeX; ++bx)
                         {
-                            Tile neighborTile = GetTile(neighborX, neighborY, neighborZ);
-                            if (!neighborTile) 
-                            {
-                                goto nocull;
-                            }
-                            
-                            Vector3 nWorldPos = GridToWorldPos(Vector3 { (float)neighborX, (float)neighborY, (float)neighborZ }, true);
-                            Matrix nRotMatrix = TileRotationMatrix(neighborTile.yaw, neighborTile.pitch);
-                            Matrix nMatrix = MatrixMultiply(nRotMatrix, MatrixTranslate(nWorldPos.x, nWorldPos.y, nWorldPos.z));
-
-                            Model neighborModel = _mapMan.get().ModelFromID(neighborTile.shape);
-                            for (int nm = 0; nm < neighborModel.meshCount; ++nm)
-                            {
-                                Mesh neighborMesh = neighborModel.meshes[nm];
-                                for (int nt = 0; nt < neighborMesh.triangleCount; ++nt)
-                                {
-                                    // Indices
-                                    unsigned short nV0Index = neighborMesh.indices[nt * 3 + 0];
-                                    unsigned short nV1Index = neighborMesh.indices[nt * 3 + 1];
-                                    unsigned short nV2Index = neighborMesh.indices[nt * 3 + 2];
-
-                                    // Vertices
-                                    Vector3 nV0 = Vector3 { neighborMesh.vertices[nV0Index * 3 + 0], neighborMesh.vertices[nV0Index * 3 + 1], neighborMesh.vertices[nV0Index * 3 + 2] };
-                                    nV0 = Vector3Transform(nV0, nMatrix);
-                                    Vector3 nV1 = Vector3 { neighborMesh.vertices[nV1Index * 3 + 0], neighborMesh.vertices[nV1Index * 3 + 1], neighborMesh.vertices[nV1Index * 3 + 2] };
-                                    nV1 = Vector3Transform(nV1, nMatrix);
-                                    Vector3 nV2 = Vector3 { neighborMesh.vertices[nV2Index * 3 + 0], neighborMesh.vertices[nV2Index * 3 + 1], neighborMesh.vertices[nV2Index * 3 + 2] };
-                                    nV2 = Vector3Transform(nV2, nMatrix);
-
-                                    // Get neighbor's plane
-                                    Vector3 nPlaneNormal = Vector3CrossProduct(nV1 - nV0, nV2 - nV0);
-                                    nPlaneNormal = Vector3Normalize(nPlaneNormal);
-
-                                    float nPlaneDistance = -Vector3DotProduct(nPlaneNormal, nV0);
-
-                                    // If the plane of the cullable triangle and the plane of the neighbor's triangle are in the same spot but opposite directions...
-                                    if (FloatEquals(fabs(nPlaneDistance), fabs(planeDistance)) && FloatEquals(Vector3DotProduct(nPlaneNormal, planeNormal), -1.0f))
-                                    {
-                                        // Cull if all of the checked triangle's points correspond one of the neighbor's.
-                                        if (
-                                            (v0 == nV0 || v0 == nV1 || v0 == nV2) && 
-                                            (v1 == nV0 || v1 == nV1 || v1 == nV2) && 
-                                            (v2 == nV0 || v2 == nV1 || v2 == nV2))
-                                        {
-                                            goto cull;
-                                        }
-                                    }
-                                }
-                            }
+                            solid[localIndex(bx, by, bz)] = false;
                         }
                     }
+                }
+
+                collision.boxes.push_back(BoundingBox {
+                    GridToWorldPos(Vector3 { (float)(i + x), (float)(j + y), (float)(k + z) }, false),
+                    GridToWorldPos(Vector3 { (float)(i + x + sizeX), (float)(j + y + sizeY), (float)(k + z + sizeZ) }, false)
+                });
+            }
+        }
+    }
+
+    // Everything else keeps its triangles, minus the ones that are hidden by neighbors (including the cubes).
+    for (const TileMesh& mesh : GenerateMeshes(i, j, k, w, h, l, true, &fullCubeShapes))
+    {
+        for (unsigned short index : mesh.indices)
+        {
+            collision.triangles.insert(collision.triangles.end(), mesh.positions.begin() + index * 3, mesh.positions.begin() + index * 3 + 3);
+        }
+    }
+
+    return collision;
+}
+
+void TileGrid::BakeAmbientOcclusion(TileMesh& mesh, const std::vector<bool>& fullCubeShapes) const
+{
+    // How much light each cel blocks. Everything outside of the grid is open.
+    auto occlusionAt = [&](int x, int y, int z)->float
+    {
+        if (x < 0 || y < 0 || z < 0 || x >= (int)_width || y >= (int)_height || z >= (int)_length) return 0.0f;
+        Tile tile = GetTile(x, y, z);
+        if (!tile) return 0.0f;
+        return IsFullCube(tile, fullCubeShapes) ? 1.0f : AO_PARTIAL_OCCLUSION;
+    };
+
+    size_t vertexCount = mesh.positions.size() / 3;
+    mesh.colors.resize(vertexCount * 3);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        Vector3 position = Vector3 { mesh.positions[v * 3], mesh.positions[v * 3 + 1], mesh.positions[v * 3 + 2] };
+        Vector3 normal = Vector3 { mesh.normals[v * 3], mesh.normals[v * 3 + 1], mesh.normals[v * 3 + 2] };
+
+        // Step half a cel out from the surface and blend the occlusion of the 8 cels whose centers surround that point.
+        // For a vertex on the corner of a cube's face, these are the 4 cels in front of the face that touch the corner.
+        Vector3 sample = (position + normal * (_spacing / 2.0f)) / _spacing - Vector3 { 0.5f, 0.5f, 0.5f };
+        int x0 = (int)floorf(sample.x), y0 = (int)floorf(sample.y), z0 = (int)floorf(sample.z);
+        float fx = sample.x - x0, fy = sample.y - y0, fz = sample.z - z0;
+        float occlusion = 0.0f;
+        for (int c = 0; c < 8; ++c)
+        {
+            int dx = c & 1, dy = (c >> 1) & 1, dz = (c >> 2) & 1;
+            float weight = (dx ? fx : 1.0f - fx) * (dy ? fy : 1.0f - fy) * (dz ? fz : 1.0f - fz);
+            if (weight > 0.0f) occlusion += weight * occlusionAt(x0 + dx, y0 + dy, z0 + dz);
+        }
 
-                    nocull:
-                    // Add indices, but with the offset of the current tile's vertices.
-                    mesh.indices.push_back(v0Index);
-                    mesh.indices.push_back(v1Index);
-                    mesh.indices.push_back(v2Index);
-                    ++mesh.triCount;
-                    cull:
-                    continue;
+        float light = 1.0f - AO_STRENGTH * Clamp(occlusion, 0.0f, 1.0f);
+        mesh.colors[v * 3] = mesh.colors[v * 3 + 1] = mesh.colors[v * 3 + 2] = light;
+    }
+}
+
+TileRayHit TileGrid::Raycast(Ray ray, int fromY, int toY, bool exactShapes) const
+{
+    TileRayHit result = { 0 };
+    fromY = Max(fromY, 0);
+    toY = Min(toY, (int)_height - 1);
+    if (_width == 0 || _length == 0 || fromY > toY) return result;
+
+    // Work in grid units, where each cel is 1 unit wide.
+    const Vector3 direction = Vector3Normalize(ray.direction);
+    const float origin[3] = { ray.position.x / _spacing, ray.position.y / _spacing, ray.position.z / _spacing };
+    const float dir[3] = { direction.x, direction.y, direction.z };
+    const int boxMin[3] = { 0, fromY, 0 };
+    const int boxMax[3] = { (int)_width, toY + 1, (int)_length };
+
+    // Clip the ray to the visible part of the grid, remembering which side it comes in through.
+    float tEnter = 0.0f, tExit = std::numeric_limits<float>::max();
+    int enterAxis = -1;
+    for (int a = 0; a < 3; ++a)
+    {
+        if (fabsf(dir[a]) < EPSILON)
+        {
+            if (origin[a] < boxMin[a] || origin[a] > boxMax[a]) return result;
+            continue;
+        }
+        float t0 = (boxMin[a] - origin[a]) / dir[a];
+        float t1 = (boxMax[a] - origin[a]) / dir[a];
+        if (t0 > t1) std::swap(t0, t1);
+        if (t0 > tEnter) 
+        {
+            tEnter = t0;
+            enterAxis = a;
+        }
+        tExit = Minf(tExit, t1);
+    }
+    if (tEnter > tExit) return result;
+
+    // Amanatides & Woo's traversal, stepping into whichever neighboring cel the ray reaches first.
+    int cel[3], step[3];
+    float tMax[3], tDelta[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        cel[a] = Min(Max((int)floorf(origin[a] + dir[a] * tEnter), boxMin[a]), boxMax[a] - 1);
+        step[a] = (dir[a] > 0.0f) ? 1 : -1;
+        if (fabsf(dir[a]) < EPSILON)
+        {
+            tMax[a] = tDelta[a] = std::numeric_limits<float>::max();
+        }
+        else
+        {
+            float boundary = (float)(step[a] > 0 ? cel[a] + 1 : cel[a]);
+            tMax[a] = (boundary - origin[a]) / dir[a];
+            tDelta[a] = 1.0f / fabsf(dir[a]);
+        }
+    }
+
+    float t = tEnter;
+    while (t <= tExit)
+    {
+        if (cel[0] < boxMin[0] || cel[1] < boxMin[1] || cel[2] < boxMin[2] || cel[0] >= boxMax[0] || cel[1] >= boxMax[1] || cel[2] >= boxMax[2]) break;
+
+        Tile tile = GetTile(cel[0], cel[1], cel[2]);
+        if (tile)
+        {
+            Vector3 side = Vector3Zero();
+            if (enterAxis >= 0)
+            {
+                float* sideComps[3] = { &side.x, &side.y, &side.z };
+                *sideComps[enterAxis] = (float)-step[enterAxis];
+            }
+
+            if (!exactShapes)
+            {
+                result.hit = true;
+                result.distance = t * _spacing;
+                result.point = ray.position + direction * result.distance;
+                result.normal = side;
+            }
+            else
+            {
+                // Test against the shape's triangles, moved into place like when drawing it.
+                Vector3 center = GridToWorldPos(Vector3 { (float)cel[0], (float)cel[1], (float)cel[2] }, true);
+                Matrix transform = TileRotationMatrix(tile.yaw, tile.pitch) * MatrixTranslate(center.x, center.y, center.z);
+                const Model shape = _mapMan.get().ModelFromID(tile.shape);
+                RayCollision closest = { 0 };
+                for (int m = 0; m < shape.meshCount; ++m)
+                {
+                    RayCollision collision = GetRayCollisionMesh(Ray { ray.position, direction }, shape.meshes[m], transform);
+                    if (collision.hit && (!closest.hit || collision.distance < closest.distance)) closest = collision;
                 }
+                if (closest.hit)
+                {
+                    result.hit = true;
+                    result.distance = closest.distance;
+                    result.point = closest.point;
+                    result.normal = closest.normal;
+                }
+            }
+
+            if (result.hit)
+            {
+                result.i = cel[0];
+                result.j = cel[1];
+                result.k = cel[2];
+                result.side = side;
+                return result;
             }
         }
+
+        int axis = (tMax[0] < tMax[1]) ? ((tMax[0] < tMax[2]) ? 0 : 2) : ((tMax[1] < tMax[2]) ? 1 : 2);
+        t = tMax[axis];
+        tMax[axis] += tDelta[axis];
+        cel[axis] += step[axis];
+        enterAxis = axis;
     }
 
-    // Create Raylib mesh
-    Model *model = SAFE_MALLOC(Model, 1);
+    return result;
+}
 
-    // Count the number of meshes (that aren't empty.)
-    int numMeshes = 0;
-    // We don't want to include any empty meshes, because that will cause an error in certain .gltf parsers.
-    for (int i = 0; i < _mapMan.get().GetNumTextures(); ++i) 
+std::vector<TileRun> TileGrid::FindConnectedRuns(int i, int j, int k, bool diagonals, int fromY, int toY) const
+{
+    std::vector<TileRun> runs;
+    fromY = Max(fromY, 0);
+    toY = Min(toY, (int)_height - 1);
+    if (i < 0 || k < 0 || j < fromY || j > toY || (size_t)i >= _width || (size_t)k >= _length) return runs;
+
+    // Empty tiles match each other no matter what their other fields are.
+    const Tile target = GetTile(i, j, k);
+    auto matches = [&](size_t index){ return target ? (_GetCelAt(index) == target) : !_GetCelAt(index); };
+
+    std::vector<bool> visited(_celCount, false);
+    struct Seed { int x, y, z; };
+    std::vector<Seed> seeds = { Seed { i, j, k } };
+    while (!seeds.empty())
     {
-        if (meshMap[i].triCount > 0) ++numMeshes;
+        Seed seed = seeds.back();
+        seeds.pop_back();
+        size_t rowStart = FlatIndex(0, seed.y, seed.z);
+        if (visited[rowStart + seed.x] || !matches(rowStart + seed.x)) continue;
+
+        // Extend the run as far as it goes in both directions along the row.
+        int x0 = seed.x, x1 = seed.x;
+        while (x0 > 0 && !visited[rowStart + x0 - 1] && matches(rowStart + x0 - 1)) --x0;
+        while (x1 < (int)_width - 1 && !visited[rowStart + x1 + 1] && matches(rowStart + x1 + 1)) ++x1;
+        std::fill(visited.begin() + rowStart + x0, visited.begin() + rowStart + x1 + 1, true);
+        runs.push_back(TileRun { rowStart + x0, (size_t)(x1 - x0 + 1) });
+
+        // Queue the first tile of each stretch of matching tiles in the neighboring rows that touch this run.
+        // Diagonal connections also reach one tile past either end of the run.
+        const int reach = diagonals ? 1 : 0;
+        for (int dy = -1; dy <= 1; ++dy)
+        {
+            for (int dz = -1; dz <= 1; ++dz)
+            {
+                if ((dy == 0 && dz == 0) || (!diagonals && dy != 0 && dz != 0)) continue;
+                int y = seed.y + dy, z = seed.z + dz;
+                if (y < fromY || y > toY || z < 0 || z >= (int)_length) continue;
+
+                size_t neighborStart = FlatIndex(0, y, z);
+                bool inStretch = false;
+                for (int x = Max(x0 - reach, 0); x <= Min(x1 + reach, (int)_width - 1); ++x)
+                {
+                    bool open = !visited[neighborStart + x] && matches(neighborStart + x);
+                    if (open && !inStretch) seeds.push_back(Seed { x, y, z });
+                    inStretch = open;
+                }
+            }
+        }
     }
 
+    return runs;
+}
+
+Model* TileGrid::_GenerateModel(bool culling)
+{
+    std::vector<TileMesh> meshes = GenerateMeshes(0, 0, 0, _width, _height, _length, culling);
+
+    // Create Raylib mesh
+    Model *model = SAFE_MALLOC(Model, 1);
+
     model->materialCount = _mapMan.get().GetNumTextures();
     model->materials = SAFE_MALLOC(Material, model->materialCount);
 
-    model->meshCount = numMeshes;
+    model->meshCount = meshes.size();
     model->meshes = SAFE_MALLOC(Mesh, model->meshCount);
     model->meshMaterial = SAFE_MALLOC(int, model->meshCount);
 
@@ -588,41 +1151,26 @@ Model* TileGrid::_GenerateModel(bool culling)
     }
     
     // Copy mesh data into Raylib mesh
-    for (int i = 0, meshIndex = 0; i < model->materialCount; ++i)
+    for (int meshIndex = 0; meshIndex < model->meshCount; ++meshIndex)
     {
-        DynMesh* dMesh = &meshMap[i];
-        if (dMesh->triCount <= 0) continue;
+        const TileMesh& tMesh = meshes[meshIndex];
 
-        model->meshMaterial[meshIndex] = i;
+        model->meshMaterial[meshIndex] = tMesh.texture;
 
         model->meshes[meshIndex] = Mesh { 0 };
-        model->meshes[meshIndex].vertexCount = dMesh->positions.size() / 3;
-        model->meshes[meshIndex].triangleCount = dMesh->triCount;
+        model->meshes[meshIndex].vertexCount = tMesh.positions.size() / 3;
+        model->meshes[meshIndex].triangleCount = tMesh.indices.size() / 3;
         
-        if (dMesh->positions.size() > 0)
-        {
-            model->meshes[meshIndex].vertices = SAFE_MALLOC(float, dMesh->positions.size());
-            memcpy(model->meshes[meshIndex].vertices, dMesh->positions.data(), dMesh->positions.size() * sizeof(float));
-        }
-        if (dMesh->texCoords.size() > 0)
-        {
-            model->meshes[meshIndex].texcoords = SAFE_MALLOC(float, dMesh->texCoords.size());
-            memcpy(model->meshes[meshIndex].texcoords, dMesh->texCoords.data(), dMesh->texCoords.size() * sizeof(float));
-        }
-        if (dMesh->normals.size() > 0)
-        {
-            model->meshes[meshIndex].normals = SAFE_MALLOC(float, dMesh->normals.size());
-            memcpy(model->meshes[meshIndex].normals, dMesh->normals.data(), dMesh->normals.size() * sizeof(float));
-        }
-        if (dMesh->indices.size() > 0)
-        {
-            model->meshes[meshIndex].indices = SAFE_MALLOC(unsigned short, dMesh->indices.size());
-            memcpy(model->meshes[meshIndex].indices, dMesh->indices.data(), dMesh->indices.size() * sizeof(unsigned short));
-        }
+        model->meshes[meshIndex].vertices = SAFE_MALLOC(float, tMesh.positions.size());
+        memcpy(model->meshes[meshIndex].vertices, tMesh.positions.data(), tMesh.positions.size() * sizeof(float));
+        model->meshes[meshIndex].texcoords = SAFE_MALLOC(float, tMesh.texCoords.size());
+        memcpy(model->meshes[meshIndex].texcoords, tMesh.texCoords.data(), tMesh.texCoords.size() * sizeof(float));
+        model->meshes[meshIndex].normals = SAFE_MALLOC(float, tMesh.normals.size());
+        memcpy(model->meshes[meshIndex].normals, tMesh.normals.data(), tMesh.normals.size() * sizeof(float));
+        model->meshes[meshIndex].indices = SAFE_MALLOC(unsigned short, tMesh.indices.size());
+        memcpy(model->meshes[meshIndex].indices, tMesh.indices.data(), tMesh.indices.size() * sizeof(unsigned short));
 
         UploadMesh(&model->meshes[meshIndex], false);
-
-        ++meshIndex;
     }
 
     return model;
@@ -643,4 +1191,14 @@ const Model TileGrid::GetModel()
     }
 
     return *_model;
+}
+
+const std::map<std::pair<TexID, Mesh*>, std::vector<Matrix>>& TileGrid::GetDrawBatches()
+{
+    if (_shouldRegenBatches || _batchFromY != 0 || _batchToY != int(_height) - 1 || _batchPosition != Vector3Zero())
+    {
+        _RegenBatches(Vector3Zero(), 0, _height - 1);
+    }
+
+    return _drawBatches;
 }
\ No newline at end of file
@@ -32,6 +32,7 @@
 #include <set>
 #include <memory>
 #include <functional>
+#include <unordered_map>
 #include <array>
 
 #include "grid.hpp"
@@ -44,6 +45,13 @@ class MapMan;
 
 enum class Direction { Z_POS, Z_NEG, X_POS, X_NEG, Y_POS, Y_NEG };
 
+// Ways that a group of tiles can be turned around while staying on the grid.
+// Rotations are around the Y axis, and clockwise turns the same way as increasing a tile's yaw.
+enum class TileTransform { ROTATE_CW, ROTATE_CCW, MIRROR_X, MIRROR_Y, MIRROR_Z };
+
+// The part of the tiles that a find and replace looks for and changes. TEXTURES means either texture slot.
+enum class ReplaceTarget { SHAPE, TEXTURES, PRIMARY_TEXTURE, SECONDARY_TEXTURE };
+
 typedef int16_t TexID;
 typedef int16_t ModelID;
 
@@ -87,12 +95,260 @@ inline bool operator!=(const Tile &lhs, const Tile &rhs)
     return !(lhs == rhs);
 }
 
+// Packs all of a tile's fields into one integer, for use as a hash map key.
+inline uint64_t TileKey(const Tile &tile)
+{
+    return uint64_t(uint16_t(tile.shape))
+        | (uint64_t(uint16_t(tile.textures[0])) << 16)
+        | (uint64_t(uint16_t(tile.textures[1])) << 32)
+        | (uint64_t(tile.yaw) << 48)
+        | (uint64_t(tile.pitch) << 56);
+}
+
+// Stores each tile in 5 bytes instead of 8: 12 bits each for the shape and the textures, then 2 bits each for the yaw and pitch.
+// IDs are stored plus one, so that empty tiles are all zeros, and must be below PACKED_TILE_ID_LIMIT.
+#define PACKED_TILE_ID_BITS 12
+#define PACKED_TILE_ID_LIMIT ((1 << PACKED_TILE_ID_BITS) - 1)
+
+struct PackedTileStorage
+{
+    struct Stored { uint8_t bytes[5]; };
+    using Chunk = ArrayChunk<Stored>;
+    static constexpr bool HAS_PALETTE = false;
+
+    // Returns true if the tile is empty, or all of its IDs are in the range that fits in 12 bits.
+    static inline bool CanPack(const Tile &tile)
+    {
+        if (!tile) return true;
+        if (tile.shape < 0 || tile.shape >= PACKED_TILE_ID_LIMIT) return false;
+        for (TexID id : tile.textures)
+        {
+            if (id < NO_TEX || id >= PACKED_TILE_ID_LIMIT) return false;
+        }
+        return true;
+    }
+    static inline bool CanPack(const std::vector<Tile> &tiles)
+    {
+        for (const Tile& tile : tiles)
+        {
+            if (!CanPack(tile)) return false;
+        }
+        return true;
+    }
+
+    static_assert(TEXTURES_PER_TILE == 2, "The packed encoding has room for two textures");
+
+    static inline Tile Unpack(const Stored &stored)
+    {
+        const uint8_t *b = stored.bytes;
+        uint64_t bits = uint64_t(b[0]) | (uint64_t(b[1]) << 8) | (uint64_t(b[2]) << 16) | (uint64_t(b[3]) << 24) | (uint64_t(b[4]) << 32);
+        const uint64_t idMask = PACKED_TILE_ID_LIMIT;
+        return Tile(
+            ModelID(int(bits & idMask) - 1), 
+            TexID(int((bits >> 12) & idMask) - 1), 
+            TexID(int((bits >> 24) & idMask) - 1), 
+            uint8_t((bits >> 36) & 3), 
+            uint8_t((bits >> 38) & 3));
+    }
+
+    // The tile's IDs must fit (see CanPack).
+    static inline Stored Pack(const Tile &tile)
+    {
+        if (!tile) return Stored{};
+        assert(tile.shape < PACKED_TILE_ID_LIMIT && tile.textures[0] < PACKED_TILE_ID_LIMIT && tile.textures[1] < PACKED_TILE_ID_LIMIT);
+        const uint64_t idMask = PACKED_TILE_ID_LIMIT;
+        uint64_t bits = (uint64_t(tile.shape + 1) & idMask)
+            | ((uint64_t(tile.textures[0] + 1) & idMask) << 12)
+            | ((uint64_t(tile.textures[1] + 1) & idMask) << 24)
+            | (uint64_t(tile.yaw & 3) << 36)
+            | (uint64_t(tile.pitch & 3) << 38);
+        Stored stored;
+        for (int i = 0; i < 5; ++i) stored.bytes[i] = uint8_t(bits >> (i * 8));
+        return stored;
+    }
+
+    static inline bool IsOccupied(const Stored &stored)
+    {
+        return stored.bytes[0] != 0 || (stored.bytes[1] & 0x0F) != 0;
+    }
+};
+
+// A chunk of tile palette indices, which uses one byte for each tile until one of the indices needs two.
+class PaletteChunk
+{
+public:
+    static constexpr size_t SIZE = size_t(1) << GRID_CHUNK_BITS;
+
+    inline explicit PaletteChunk(uint16_t fill)
+    {
+        if (fill <= UINT8_MAX) _narrow.assign(SIZE, uint8_t(fill));
+        else _wide.assign(SIZE, fill);
+    }
+
+    inline uint16_t Get(size_t index) const
+    {
+        return _wide.empty() ? _narrow[index] : _wide[index];
+    }
+
+    inline void Set(size_t index, uint16_t paletteIndex)
+    {
+        if (_wide.empty())
+        {
+            if (paletteIndex <= UINT8_MAX)
+            {
+                _narrow[index] = uint8_t(paletteIndex);
+                return;
+            }
+            _wide.assign(_narrow.begin(), _narrow.end());
+            _narrow = std::vector<uint8_t>();
+        }
+        _wide[index] = paletteIndex;
+    }
+
+    inline bool IsWide() const { return !_wide.empty(); }
+private:
+    std::vector<uint8_t> _narrow;
+    std::vector<uint16_t> _wide;
+};
+
+// Stores each tile as an index into a palette of the different tiles in the grid, which is added to as new tiles are placed.
+// Index 0 is always the empty tile. The palette holds up to 65536 tiles. When it is full, the grid compacts it to the tiles that are still used.
+// Copies of the storage share the palette until one of them adds to it.
+class PaletteTileStorage
+{
+public:
+    using Stored = uint16_t;
+    using Chunk = PaletteChunk;
+    static constexpr bool HAS_PALETTE = true;
+    static constexpr size_t MAX_PALETTE_SIZE = size_t(UINT16_MAX) + 1;
+
+    inline PaletteTileStorage() : _palette(std::make_shared<Palette>()) { _palette->tiles.push_back(Tile()); }
+
+    inline Tile Unpack(uint16_t index) const { return _palette->tiles[index]; }
+    // The tile must fit in the palette (see CanPack).
+    uint16_t Pack(const Tile &tile);
+    inline bool IsOccupied(uint16_t index) const { return index != 0; }
+
+    // Returns true if the tile is empty, already in the palette, or there is room to add it.
+    inline bool CanPack(const Tile &tile) const
+    {
+        return !tile || _palette->tiles.size() < MAX_PALETTE_SIZE || _palette->indices.count(TileKey(tile)) > 0;
+    }
+    // Returns true if there is room in the palette for all of the tiles.
+    bool CanPack(const std::vector<Tile> &tiles) const;
+
+    // Removes the tiles that aren't marked as used, keeping the empty tile, and returns the new index for each old one.
+    std::vector<uint16_t> Compact(const std::vector<bool> &used);
+
+    inline const std::vector<Tile>& GetPalette() const { return _palette->tiles; }
+private:
+    struct Palette
+    {
+        std::vector<Tile> tiles;
+        std::unordered_map<uint64_t, uint16_t> indices; // Palette index of each tile, keyed by all of the tile's fields
+    };
+    std::shared_ptr<Palette> _palette;
+
+};
+
+// Numbers the different tiles found while going through a grid, so that work that only depends on the tile can be done once per number.
+// Unlike PaletteTileStorage, it can hold any number of tiles. Number 0 is always the empty tile.
+class LocalTilePalette
+{
+public:
+    inline LocalTilePalette() : _tiles(1) {}
+
+    // Returns the tile's number, adding it if it hasn't been seen yet.
+    uint32_t Add(const Tile &tile);
+    inline const std::vector<Tile>& GetTiles() const { return _tiles; }
+private:
+    std::vector<Tile> _tiles;
+    std::unordered_map<uint64_t, uint32_t> _indices;
+};
+
 inline Matrix TileRotationMatrix(uint8_t tileYaw, uint8_t tilePitch)
 {
     return MatrixRotateX(float(tilePitch % 4) * -PI / 2.0f) * MatrixRotateY(float(tileYaw % 4) * -PI / 2.0f);
 }
 
-class TileGrid : public Grid<Tile>
+inline Matrix TileTransformMatrix(TileTransform transform)
+{
+    switch (transform)
+    {
+    case TileTransform::ROTATE_CW:  return MatrixRotateY(-PI / 2.0f);
+    case TileTransform::ROTATE_CCW: return MatrixRotateY(PI / 2.0f);
+    case TileTransform::MIRROR_X:   return MatrixScale(-1.0f, 1.0f, 1.0f);
+    case TileTransform::MIRROR_Y:   return MatrixScale(1.0f, -1.0f, 1.0f);
+    case TileTransform::MIRROR_Z:   return MatrixScale(1.0f, 1.0f, -1.0f);
+    }
+    return MatrixIdentity();
+}
+
+// Returns the tile with its yaw and pitch changed so that it looks like it was turned by the transform.
+// Shapes can't be mirrored, so mirrored tiles get the rotation that mirrors their orientation instead.
+// This is exact for shapes that are symmetrical across the plane of the mirror.
+Tile TransformTile(Tile tile, TileTransform transform);
+
+// Vertex data for all of the geometry with one texture in part of a TileGrid.
+struct TileMesh
+{
+    TexID texture;
+    std::vector<float> positions;
+    std::vector<float> texCoords;
+    std::vector<float> normals;
+    std::vector<unsigned short> indices;
+    std::vector<float> colors; // RGB for each vertex. Left empty unless BakeAmbientOcclusion is called, which should come after any other processing.
+};
+
+// Simplified geometry for physics in part of a TileGrid.
+struct TileCollision
+{
+    std::vector<BoundingBox> boxes; // Boxes in world space that cover all of the full cube tiles
+    std::vector<float> triangles; // Positions of the triangles of the other tiles, three vertices at a time
+};
+
+// A row of tiles along the X axis, starting at the flat index `start`.
+struct TileRun
+{
+    size_t start;
+    size_t count;
+};
+
+// Where a ray cast into a TileGrid first hit a tile.
+struct TileRayHit
+{
+    bool hit;
+    int i, j, k; // Grid coordinates of the tile that was hit
+    Vector3 point; // World position of the hit
+    Vector3 normal; // Normal of the surface that was hit
+    Vector3 side; // Axis aligned normal of the cel side that the ray came in through, or zero if it started inside of the cel.
+    float distance;
+};
+
+// Building with TILE_GRID_MORTON_LAYOUT defined stores tiles in Morton ordered bricks, which keeps the tiles above and below each one nearby in memory.
+// Otherwise, tiles are stored in the same order as their flat indices.
+#ifdef TILE_GRID_MORTON_LAYOUT
+using TileGridLayout = MortonLayout;
+#else
+using TileGridLayout = LinearLayout;
+#endif
+
+// Building with TILE_GRID_PACKED_TILES defined stores tiles with PackedTileStorage, which limits the number of shapes and textures in a map.
+// Building with TILE_GRID_TILE_PALETTE defined stores tiles with PaletteTileStorage instead.
+#if defined(TILE_GRID_PACKED_TILES)
+using TileGridStorage = PackedTileStorage;
+#define TILE_ID_LIMIT PACKED_TILE_ID_LIMIT
+#elif defined(TILE_GRID_TILE_PALETTE)
+using TileGridStorage = PaletteTileStorage;
+#define TILE_ID_LIMIT INT16_MAX
+#else
+using TileGridStorage = PlainCelStorage<Tile>;
+#define TILE_ID_LIMIT INT16_MAX
+#endif
+
+using TileGridBase = Grid<Tile, TileGridLayout, TileGridStorage>;
+
+class TileGrid : public TileGridBase
 {
 public:
     // Constructs a TileGrid full of empty tiles.
@@ -105,21 +361,31 @@ public:
 
     Tile GetTile(int i, int j, int k) const;
     Tile GetTile(int flatIndex) const;
-    void SetTile(int i, int j, int k, const Tile& tile);
-    void SetTile(int flatIndex, const Tile& tile);
+    // The functions that set tiles return false without changing anything if the grid's storage has no room for the new tiles.
+    // This only happens when a palette is full of different tiles that are all in use (see PaletteTileStorage).
+    bool SetTile(int i, int j, int k, const Tile& tile);
+    bool SetTile(int flatIndex, const Tile& tile);
+
+    // Sets `count` tiles in a row along the X axis, starting at the flat index.
+    bool SetTileRun(size_t flatIndex, size_t count, const Tile& tile);
 
     // Sets a range of tiles in the grid inside of the rectangular prism with a corner at (i, j, k) and size (w, h, l).
-    void SetTileRect(int i, int j, int k, int w, int h, int l, const Tile& tile);
+    bool SetTileRect(int i, int j, int k, int w, int h, int l, const Tile& tile);
 
     // Takes the tiles of `src` and places them in this grid starting at the offset at (i, j, k)
     // If the offset results in `src` exceeding the current grid's boundaries, it is cut off.
     // If `ignoreEmpty` is true, then empty tiles do not overwrite existing tiles.
-    void CopyTiles(int i, int j, int k, const TileGrid &src, bool ignoreEmpty = false);
+    bool CopyTiles(int i, int j, int k, const TileGrid &src, bool ignoreEmpty = false);
+
+    // Returns true if all of the tiles can be stored in the grid, making room for them if needed.
+    // Check this before setting several different tiles that should either all be set or not at all.
+    bool MakeRoomForTiles(const std::vector<Tile>& tiles);
 
 
     void UnsetTile(int i, int j, int k);
 
     // Returns a smaller TileGrid with a copy of the tile data in the rectangle defined by coordinates (i, j, k) and size (w, h, l).
+    // Copying the whole grid this way shares the tile data instead, without the cached draw batches and model.
     TileGrid Subsection(int i, int j, int k, int w, int h, int l) const;
 
     // Draws the tile grid, hiding all layers that are outside of the given y coordinate range.
@@ -131,25 +397,72 @@ public:
     std::string GetTileDataBase64() const;
 
     // Assigns tiles based on base 64 encoded data from Total Edtor 3.1 or earlier.
+    // Throws std::runtime_error if the data is truncated or does not fit in the grid.
     void SetTileDataBase64OldFormat(std::string data);
 
     // Assigns tiles based on the binary data encoded in base 64. Assumes that the sizes of the data and the current grid are the same.
+    // Throws std::runtime_error if the data is truncated or does not fit in the grid.
     void SetTileDataBase64(std::string data);
 
     // Returns the list of texture and model IDs that are actually used in this tile grid
     std::pair<std::vector<TexID>, std::vector<ModelID>> GetUsedIDs() const;
 
     const Model GetModel();
+
+    // Generates the geometry of the tiles inside of the rectangular prism with a corner at (i, j, k) and size (w, h, l), with one mesh per texture.
+    // When culling is true, faces hidden by neighboring tiles (including those outside of the prism) are removed.
+    // Tiles whose shapes are marked in `excludedShapes` (indexed by ModelID) are left out.
+    // This does not touch any GPU resources, so it is safe to call from multiple threads at once.
+    std::vector<TileMesh> GenerateMeshes(int i, int j, int k, int w, int h, int l, bool culling, const std::vector<bool>* excludedShapes = nullptr) const;
+
+    // Returns whether each shape, by ModelID, fills its whole grid cel like a cube.
+    std::vector<bool> GetFullCubeShapes() const;
+    // Returns true if the tile's shape is marked in `fullCubeShapes`. Empty tiles and shapes that aren't in the list are not full cubes.
+    static inline bool IsFullCube(const Tile &tile, const std::vector<bool> &fullCubeShapes)
+    {
+        return tile && tile.shape >= 0 && tile.shape < (ModelID)fullCubeShapes.size() && fullCubeShapes[tile.shape];
+    }
+
+    // Generates collision geometry for the tiles inside of the rectangular prism with a corner at (i, j, k) and size (w, h, l).
+    // The tiles with shapes marked in `fullCubeShapes` are merged into as few boxes as possible, while the rest use their culled triangles.
+    // Like GenerateMeshes, this is safe to call from multiple threads at once.
+    TileCollision GenerateCollision(int i, int j, int k, int w, int h, int l, const std::vector<bool>& fullCubeShapes) const;
+
+    // Fills in the mesh's vertex colors with ambient occlusion, darkening vertices that are surrounded by the tiles in front of them.
+    // The mesh is expected to be generated from this grid. Tiles with shapes marked in `fullCubeShapes` block more light than others.
+    // Like GenerateMeshes, this is safe to call from multiple threads at once.
+    void BakeAmbientOcclusion(TileMesh& mesh, const std::vector<bool>& fullCubeShapes) const;
+
+    // Finds the first tile that the ray hits, ignoring layers outside of the given y coordinate range.
+    // Only the cels that the ray passes through inside of the grid are visited, in order, so the cost does not depend on the size of the map.
+    // If `exactShapes` is true, the ray has to hit the triangles of the tile's shape. Otherwise, it stops at the first occupied cel.
+    TileRayHit Raycast(Ray ray, int fromY, int toY, bool exactShapes) const;
+
+    // Returns the rows of tiles that are connected to the tile at (i, j, k) and equal to it, staying within the given y coordinate range.
+    // Tiles are connected through their sides, or also through their edges and corners if `diagonals` is true.
+    // This is a scanline fill, which visits each row of matching tiles once instead of every tile's neighbors.
+    std::vector<TileRun> FindConnectedRuns(int i, int j, int k, bool diagonals, int fromY, int toY) const;
+
+    // Returns the transforms of every tile in the grid, grouped by texture and shape mesh.
+    const std::map<std::pair<TexID, Mesh*>, std::vector<Matrix>>& GetDrawBatches();
 protected:
     std::reference_wrapper<MapMan> _mapMan;
 
     // Calculates lists of transformations for each tile, separated by texture and shape, to be drawn as instances.
     void _RegenBatches(Vector3 position, int fromY, int toY);
-    // Combines all of the tiles into a single model, for export or for preview. When culling is true, redundant faces between tiles are removed.
+    // Clears `runLength` tiles starting at `gridIndex`, throwing if the run would go past the end of the grid.
+    void _FillEmptyRun(size_t gridIndex, size_t runLength);
+    // Combines all of the tiles into a single model for the preview. When culling is true, redundant faces between tiles are removed.
     Model* _GenerateModel(bool culling = true);
+    // Returns true if the triangle belonging to the tile at (i, j, k) is covered up by a face of the neighboring tile.
+    bool _IsFaceHidden(Vector3 v0, Vector3 v1, Vector3 v2, int i, int j, int k) const;
+    // Returns the index of the tile at (i, j, k) in the grid's tile palette, so work that only depends on the tile can be done once per index.
+    // Grids that aren't stored with a palette number their tiles in `localPalette` instead. Index 0 is always the empty tile.
+    uint32_t _GetPaletteIndex(int i, int j, int k, LocalTilePalette& localPalette) const;
+    const std::vector<Tile>& _GetPalette(const LocalTilePalette& localPalette) const;
 
     std::map<std::pair<TexID, Mesh*>, std::vector<Matrix>> _drawBatches;
-    
+
     Vector3 _batchPosition;
     bool _shouldRegenBatches;
     bool _regenModel;